@@ -0,0 +1,236 @@
+#include "Bounds.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_BOUNDS_SSE
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+    #include <arm_neon.h>
+    #define GPS_BOUNDS_NEON
+#endif
+
+namespace gps {
+
+    namespace {
+
+        // x, y, z and one lane nobody reads, a single SIMD register where available
+#if defined (GPS_BOUNDS_SSE)
+        typedef __m128 Lanes;
+        inline Lanes LoadLanes(const float* p) { return _mm_loadu_ps(p); }
+        inline void StoreLanes(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+        inline Lanes MinLanes(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+        inline Lanes MaxLanes(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+#elif defined (GPS_BOUNDS_NEON)
+        typedef float32x4_t Lanes;
+        inline Lanes LoadLanes(const float* p) { return vld1q_f32(p); }
+        inline void StoreLanes(float* p, Lanes v) { vst1q_f32(p, v); }
+        inline Lanes MinLanes(Lanes a, Lanes b) { return vminq_f32(a, b); }
+        inline Lanes MaxLanes(Lanes a, Lanes b) { return vmaxq_f32(a, b); }
+#else
+        struct Lanes { float c[4]; };
+        inline Lanes LoadLanes(const float* p) { Lanes v; memcpy(v.c, p, sizeof(v.c)); return v; }
+        inline void StoreLanes(float* p, Lanes v) { memcpy(p, v.c, sizeof(v.c)); }
+        inline Lanes MinLanes(Lanes a, Lanes b) {
+            for (int i = 0; i < 4; i++) {
+                a.c[i] = std::min(a.c[i], b.c[i]);
+            }
+            return a;
+        }
+        inline Lanes MaxLanes(Lanes a, Lanes b) {
+            for (int i = 0; i < 4; i++) {
+                a.c[i] = std::max(a.c[i], b.c[i]);
+            }
+            return a;
+        }
+#endif
+
+        inline const glm::vec3& PositionAt(const char* base, size_t i, size_t stride) {
+            return *(const glm::vec3*)(base + i * stride);
+        }
+
+        // Loading four floats reads past the end of the last position, which
+        // is copied out first
+        inline Lanes LoadLastPosition(const glm::vec3& position) {
+            float padded[4] = { position.x, position.y, position.z, position.z };
+            return LoadLanes(padded);
+        }
+    }
+
+    BoundingBox EmptyBox() {
+        BoundingBox box;
+        box.min = glm::vec3(std::numeric_limits<float>::max());
+        box.max = glm::vec3(-std::numeric_limits<float>::max());
+        return box;
+    }
+
+    Bounds EmptyBounds() {
+        Bounds bounds;
+        bounds.box = EmptyBox();
+        bounds.sphere.center = glm::vec3(0.0f);
+        bounds.sphere.radius = -1.0f;
+        return bounds;
+    }
+
+    bool IsEmpty(const BoundingBox& box) {
+        return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+    }
+
+    BoundingBox ComputeBox(const glm::vec3* positions, size_t count, size_t stride) {
+        if (count == 0) {
+            return EmptyBox();
+        }
+
+        const char* base = (const char*)positions;
+        size_t last = count - 1;
+        Lanes lastPosition = LoadLastPosition(PositionAt(base, last, stride));
+
+        //two accumulators, so consecutive min/max do not wait on each other
+        Lanes low0 = lastPosition, high0 = lastPosition;
+        Lanes low1 = lastPosition, high1 = lastPosition;
+        size_t i = 0;
+        for (; i + 2 <= last; i += 2) {
+            Lanes a = LoadLanes(&PositionAt(base, i, stride).x);
+            Lanes b = LoadLanes(&PositionAt(base, i + 1, stride).x);
+            low0 = MinLanes(low0, a);
+            high0 = MaxLanes(high0, a);
+            low1 = MinLanes(low1, b);
+            high1 = MaxLanes(high1, b);
+        }
+        if (i < last) {
+            Lanes a = LoadLanes(&PositionAt(base, i, stride).x);
+            low0 = MinLanes(low0, a);
+            high0 = MaxLanes(high0, a);
+        }
+
+        float low[4];
+        float high[4];
+        StoreLanes(low, MinLanes(low0, low1));
+        StoreLanes(high, MaxLanes(high0, high1));
+
+        BoundingBox box;
+        box.min = glm::vec3(low[0], low[1], low[2]);
+        box.max = glm::vec3(high[0], high[1], high[2]);
+        return box;
+    }
+
+    BoundingBox ComputeBox(const Vertex* vertices, size_t count) {
+        if (count == 0) {
+            return EmptyBox();
+        }
+        return ComputeBox(&vertices[0].Position, count, sizeof(Vertex));
+    }
+
+    BoundingSphere ComputeSphere(const glm::vec3* positions, size_t count, size_t stride, const BoundingBox& box) {
+        BoundingSphere sphere;
+        if (count == 0 || IsEmpty(box)) {
+            sphere.center = glm::vec3(0.0f);
+            sphere.radius = -1.0f;
+            return sphere;
+        }
+
+        sphere.center = (box.min + box.max) * 0.5f;
+        const char* base = (const char*)positions;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 offset = PositionAt(base, i, stride) - sphere.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        sphere.radius = std::sqrt(radiusSquared);
+        return sphere;
+    }
+
+    Bounds ComputeBounds(const Vertex* vertices, size_t count) {
+        if (count == 0) {
+            return EmptyBounds();
+        }
+
+        Bounds bounds;
+        bounds.box = ComputeBox(vertices, count);
+        bounds.sphere = ComputeSphere(&vertices[0].Position, count, sizeof(Vertex), bounds.box);
+        return bounds;
+    }
+
+    Bounds MergeBounds(const Bounds& a, const Bounds& b) {
+        if (IsEmpty(a.box)) {
+            return b;
+        }
+        if (IsEmpty(b.box)) {
+            return a;
+        }
+
+        Bounds merged;
+        merged.box.min = glm::min(a.box.min, b.box.min);
+        merged.box.max = glm::max(a.box.max, b.box.max);
+
+        //around the box's center, reaching the far side of both spheres
+        glm::vec3 center = (merged.box.min + merged.box.max) * 0.5f;
+        float boxRadius = std::max(glm::length(a.sphere.center - center) + a.sphere.radius,
+                                   glm::length(b.sphere.center - center) + b.sphere.radius);
+
+        //the smallest sphere around both
+        glm::vec3 offset = b.sphere.center - a.sphere.center;
+        float distance = glm::length(offset);
+        BoundingSphere around;
+        if (distance + b.sphere.radius <= a.sphere.radius) {
+            around = a.sphere;
+        } else if (distance + a.sphere.radius <= b.sphere.radius) {
+            around = b.sphere;
+        } else {
+            around.radius = (distance + a.sphere.radius + b.sphere.radius) * 0.5f;
+            around.center = a.sphere.center + offset * ((around.radius - a.sphere.radius) / distance);
+        }
+
+        if (around.radius < boxRadius) {
+            merged.sphere = around;
+        } else {
+            merged.sphere.center = center;
+            merged.sphere.radius = boxRadius;
+        }
+        return merged;
+    }
+
+    BoundingBox TransformBox(const BoundingBox& box, const glm::mat4& transform) {
+        if (IsEmpty(box)) {
+            return box;
+        }
+
+        //each column of the matrix adds its smaller and larger end separately (Arvo)
+        BoundingBox transformed;
+        transformed.min = transformed.max = glm::vec3(transform[3]);
+        for (int column = 0; column < 3; column++) {
+            glm::vec3 axis(transform[column]);
+            glm::vec3 a = axis * box.min[column];
+            glm::vec3 b = axis * box.max[column];
+            transformed.min += glm::min(a, b);
+            transformed.max += glm::max(a, b);
+        }
+        return transformed;
+    }
+
+    BoundingSphere TransformSphere(const BoundingSphere& sphere, const glm::mat4& transform) {
+        BoundingSphere transformed;
+        transformed.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+        if (sphere.radius < 0.0f) {
+            transformed.radius = sphere.radius;
+            return transformed;
+        }
+
+        //the largest scale of the three axes covers non-uniform scaling
+        float scale = std::max(glm::length(glm::vec3(transform[0])),
+                               std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        transformed.radius = sphere.radius * scale;
+        return transformed;
+    }
+
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& transform) {
+        Bounds transformed;
+        transformed.box = TransformBox(bounds.box, transform);
+        transformed.sphere = TransformSphere(bounds.sphere, transform);
+        return transformed;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef Bounds_hpp
+#define Bounds_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace gps {
+
+    struct Vertex;
+
+    // Axis-aligned box; empty when min > max on any axis
+    struct BoundingBox {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Empty when radius < 0
+    struct BoundingSphere {
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Both volumes of the same points: the box for tests against planes and
+    // cascades, the sphere for distances and quick rejection
+    struct Bounds {
+        BoundingBox box;
+        BoundingSphere sphere;
+    };
+
+    // Contains nothing, and merges into anything unchanged
+    BoundingBox EmptyBox();
+    Bounds EmptyBounds();
+    bool IsEmpty(const BoundingBox& box);
+
+    // Min/max over `count` positions `stride` bytes apart, four lanes at a
+    // time with SSE where the compiler targets it
+    BoundingBox ComputeBox(const glm::vec3* positions, size_t count, size_t stride);
+    BoundingBox ComputeBox(const Vertex* vertices, size_t count);
+
+    // Sphere around the box's center, just large enough for the positions;
+    // tighter than the box's half diagonal
+    BoundingSphere ComputeSphere(const glm::vec3* positions, size_t count, size_t stride, const BoundingBox& box);
+
+    // Box and sphere of a mesh's vertices
+    Bounds ComputeBounds(const Vertex* vertices, size_t count);
+
+    // Bounds of both, for the bounds of a model from those of its meshes. The
+    // sphere is the smaller of the one around both spheres and the one around
+    // the merged box's center.
+    Bounds MergeBounds(const Bounds& a, const Bounds& b);
+
+    // Bounds of the transformed volume under an affine model matrix, e.g.
+    // model space to world space; the box stays axis-aligned, so it grows under
+    // rotations
+    BoundingBox TransformBox(const BoundingBox& box, const glm::mat4& transform);
+    BoundingSphere TransformSphere(const BoundingSphere& sphere, const glm::mat4& transform);
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& transform);
+}
+
+#endif /* Bounds_hpp */
@@ -18,6 +18,12 @@ namespace gps {
         return glm::lookAt(cameraPosition, cameraTarget, this->cameraUpDirection);
     }
 
+    //return the camera position in world space
+    glm::vec3 Camera::getPosition() const {
+
+        return cameraPosition;
+    }
+
     //update the camera internal parameters following a camera move event
     void Camera::move(MOVE_DIRECTION direction, float speed) {
         //TODO
@@ -0,0 +1,125 @@
+#include "GLHandle.hpp"
+#include "RenderState.hpp"
+
+namespace gps {
+
+    namespace {
+
+        const char* ObjectTypeName(GLObjectType type) {
+            switch (type) {
+                case OBJECT_BUFFER: return "buffer(s)";
+                case OBJECT_VERTEX_ARRAY: return "vertex array(s)";
+                case OBJECT_TEXTURE: return "texture(s)";
+                case OBJECT_PROGRAM: return "program(s)";
+                default: return "object(s)";
+            }
+        }
+    }
+
+    GLObjectTracker::GLObjectTracker() {
+        for (int i = 0; i < OBJECT_TYPE_COUNT; i++) {
+            objects[i].live = 0;
+            objects[i].bytes = 0;
+            objects[i].created = 0;
+        }
+    }
+
+    GLObjectTracker& GLObjectTracker::shared() {
+        static GLObjectTracker tracker;
+        return tracker;
+    }
+
+    void GLObjectTracker::created(GLObjectType type) {
+        objects[type].live++;
+        objects[type].created++;
+    }
+
+    void GLObjectTracker::deleted(GLObjectType type, size_t bytes) {
+        objects[type].live--;
+        objects[type].bytes -= bytes;
+    }
+
+    void GLObjectTracker::resized(GLObjectType type, size_t oldBytes, size_t newBytes) {
+        objects[type].bytes += newBytes - oldBytes;
+    }
+
+    GLObjectStats GLObjectTracker::stats(GLObjectType type) const {
+        return objects[type];
+    }
+
+    size_t GLObjectTracker::liveObjects() const {
+        size_t live = 0;
+        for (int i = 0; i < OBJECT_TYPE_COUNT; i++) {
+            live += objects[i].live;
+        }
+        return live;
+    }
+
+    bool GLObjectTracker::report(std::ostream& out) const {
+        size_t live = liveObjects();
+        if (live == 0) {
+            out << "GL objects     : none left alive" << std::endl;
+            return true;
+        }
+
+        out << "WARNING: " << live << " GL object(s) still alive:";
+        for (int i = 0; i < OBJECT_TYPE_COUNT; i++) {
+            if (objects[i].live > 0) {
+                out << " " << objects[i].live << " " << ObjectTypeName((GLObjectType)i)
+                    << " (" << objects[i].bytes / 1024 << " KB)";
+            }
+        }
+        out << std::endl;
+        return false;
+    }
+
+    GLuint CreateGLObject(GLObjectType type) {
+        GLuint id = 0;
+        switch (type) {
+            case OBJECT_BUFFER:
+                glGenBuffers(1, &id);
+                break;
+            case OBJECT_VERTEX_ARRAY:
+                glGenVertexArrays(1, &id);
+                break;
+            case OBJECT_TEXTURE:
+                glGenTextures(1, &id);
+                break;
+            case OBJECT_PROGRAM:
+                id = glCreateProgram();
+                break;
+            default:
+                break;
+        }
+
+        if (id != 0) {
+            GLObjectTracker::shared().created(type);
+        }
+        return id;
+    }
+
+    void DeleteGLObject(GLObjectType type, GLuint id, size_t bytes) {
+        //GL unbinds deleted objects, so does the shadow copy
+        switch (type) {
+            case OBJECT_BUFFER:
+                glDeleteBuffers(1, &id);
+                break;
+            case OBJECT_VERTEX_ARRAY:
+                glDeleteVertexArrays(1, &id);
+                RenderState::current().forgetVertexArray(id);
+                break;
+            case OBJECT_TEXTURE:
+                glDeleteTextures(1, &id);
+                RenderState::current().forgetTexture(id);
+                break;
+            case OBJECT_PROGRAM:
+                glDeleteProgram(id);
+                RenderState::current().forgetProgram(id);
+                break;
+            default:
+                break;
+        }
+
+        GLObjectTracker::shared().deleted(type, bytes);
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef GLHandle_hpp
+#define GLHandle_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <ostream>
+
+namespace gps {
+
+    enum GLObjectType {
+        OBJECT_BUFFER,
+        OBJECT_VERTEX_ARRAY,
+        OBJECT_TEXTURE,
+        OBJECT_PROGRAM,
+        OBJECT_TYPE_COUNT
+    };
+
+    struct GLObjectStats {
+        size_t live;
+        size_t bytes;       //video memory reported through GLHandle::setBytes
+        size_t created;
+    };
+
+    // Counts the GL objects created and deleted through GLHandle, so whatever is
+    // still alive when the context goes away can be reported. Like the handles
+    // themselves it is only used on the thread owning the GL context.
+    class GLObjectTracker {
+
+    public:
+        static GLObjectTracker& shared();
+
+        void created(GLObjectType type);
+        void deleted(GLObjectType type, size_t bytes);
+        void resized(GLObjectType type, size_t oldBytes, size_t newBytes);
+
+        GLObjectStats stats(GLObjectType type) const;
+        size_t liveObjects() const;
+
+        // Prints the live objects and bytes of every type; returns false if anything leaked
+        bool report(std::ostream& out) const;
+
+    private:
+        GLObjectStats objects[OBJECT_TYPE_COUNT];
+
+        GLObjectTracker();
+        GLObjectTracker(const GLObjectTracker&);
+        GLObjectTracker& operator=(const GLObjectTracker&);
+    };
+
+    // Generate and delete one GL object of a type, keeping the tracker and the
+    // RenderState shadow copy up to date
+    GLuint CreateGLObject(GLObjectType type);
+    void DeleteGLObject(GLObjectType type, GLuint id, size_t bytes);
+
+    // Owns one GL object: deleted with the handle, moved but never copied.
+    // An empty handle holds the name 0.
+    template <GLObjectType Type>
+    class GLHandle {
+
+    public:
+        GLHandle() : id(0), bytes(0) {}
+
+        ~GLHandle() {
+            reset();
+        }
+
+        GLHandle(GLHandle&& other) noexcept : id(other.id), bytes(other.bytes) {
+            other.id = 0;
+            other.bytes = 0;
+        }
+
+        GLHandle& operator=(GLHandle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                id = other.id;
+                bytes = other.bytes;
+                other.id = 0;
+                other.bytes = 0;
+            }
+            return *this;
+        }
+
+        GLHandle(const GLHandle&) = delete;
+        GLHandle& operator=(const GLHandle&) = delete;
+
+        static GLHandle create() {
+            GLHandle handle;
+            handle.id = CreateGLObject(Type);
+            return handle;
+        }
+
+        GLuint get() const { return id; }
+        explicit operator bool() const { return id != 0; }
+
+        // Records the video memory held by the object, for the leak report
+        void setBytes(size_t size) {
+            GLObjectTracker::shared().resized(Type, bytes, size);
+            bytes = size;
+        }
+        size_t getBytes() const { return bytes; }
+
+        void reset() {
+            if (id != 0) {
+                DeleteGLObject(Type, id, bytes);
+                id = 0;
+                bytes = 0;
+            }
+        }
+
+    private:
+        GLuint id;
+        size_t bytes;
+    };
+
+    typedef GLHandle<OBJECT_BUFFER> BufferHandle;
+    typedef GLHandle<OBJECT_VERTEX_ARRAY> VertexArrayHandle;
+    typedef GLHandle<OBJECT_TEXTURE> TextureHandle;
+    typedef GLHandle<OBJECT_PROGRAM> ProgramHandle;
+}
+
+#endif /* GLHandle_hpp */
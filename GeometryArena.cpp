@@ -0,0 +1,279 @@
+#include "GeometryArena.hpp"
+#include "Mesh.hpp"
+#include "RenderState.hpp"
+#include "VertexQuantization.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace gps {
+
+    namespace {
+
+        // Smallest buffers an arena starts with, 2 MB of gps::Vertex
+        const size_t MIN_VERTEX_CAPACITY = 64 * 1024;
+        const size_t MIN_INDEX_CAPACITY = 3 * MIN_VERTEX_CAPACITY;
+
+        // At least `needed` past the old end, so the allocation fits however fragmented the old space is
+        size_t GrownCapacity(size_t capacity, size_t needed, size_t minimum) {
+            return std::max(std::max(capacity * 2, capacity + needed), minimum);
+        }
+
+        // Copies the used part of a buffer into a larger one, on the GPU
+        BufferHandle GrowBuffer(BufferHandle& old, size_t oldBytes, size_t newBytes) {
+            BufferHandle grown = BufferHandle::create();
+            //the copy targets leave the VAO's element buffer binding alone
+            glBindBuffer(GL_COPY_WRITE_BUFFER, grown.get());
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)newBytes, NULL, GL_STATIC_DRAW);
+            grown.setBytes(newBytes);
+
+            if (old && oldBytes > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, old.get());
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)oldBytes);
+            }
+            return grown;
+        }
+    }
+
+    RangeAllocator::RangeAllocator()
+        : total(0), allocated(0) {
+    }
+
+    bool RangeAllocator::allocate(size_t size, size_t* offset) {
+        for (std::map<size_t, size_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < size) {
+                continue;
+            }
+
+            *offset = it->first;
+            size_t remaining = it->second - size;
+            freeRanges.erase(it);
+            if (remaining > 0) {
+                freeRanges[*offset + size] = remaining;
+            }
+            allocated += size;
+            return true;
+        }
+        return false;
+    }
+
+    void RangeAllocator::free(size_t offset, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        allocated -= size;
+
+        std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            std::map<size_t, size_t>::iterator previous = next;
+            --previous;
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    void RangeAllocator::grow(size_t newCapacity) {
+        if (newCapacity <= total) {
+            return;
+        }
+        size_t added = newCapacity - total;
+        //free() merges the new space with a free range at the end
+        allocated += added;
+        size_t offset = total;
+        total = newCapacity;
+        free(offset, added);
+    }
+
+    size_t RangeAllocator::capacity() const {
+        return total;
+    }
+
+    size_t RangeAllocator::used() const {
+        return allocated;
+    }
+
+    VertexFormat StandardVertexFormat() {
+        VertexFormat format;
+        format.stride = sizeof(Vertex);
+
+        VertexAttribute position = { 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position) };
+        VertexAttribute normal = { 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal) };
+        VertexAttribute texCoords = { 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords) };
+        format.attributes.push_back(position);
+        format.attributes.push_back(normal);
+        format.attributes.push_back(texCoords);
+        return format;
+    }
+
+    void ApplyVertexFormat(const VertexFormat& format, GLuint vertexBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        for (size_t i = 0; i < format.attributes.size(); i++) {
+            const VertexAttribute& attribute = format.attributes[i];
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  format.stride, (const GLvoid*)attribute.offset);
+        }
+    }
+
+    GeometryRange::GeometryRange()
+        : arena(NULL), firstVertex(0), vertices(0), indexOffset(0), indices(0) {
+    }
+
+    GeometryRange::~GeometryRange() {
+        reset();
+    }
+
+    GeometryRange::GeometryRange(GeometryRange&& other) noexcept
+        : arena(other.arena), firstVertex(other.firstVertex), vertices(other.vertices),
+          indexOffset(other.indexOffset), indices(other.indices) {
+        other.arena = NULL;
+    }
+
+    GeometryRange& GeometryRange::operator=(GeometryRange&& other) noexcept {
+        if (this != &other) {
+            reset();
+            arena = other.arena;
+            firstVertex = other.firstVertex;
+            vertices = other.vertices;
+            indexOffset = other.indexOffset;
+            indices = other.indices;
+            other.arena = NULL;
+        }
+        return *this;
+    }
+
+    void GeometryRange::reset() {
+        if (arena) {
+            arena->free(*this);
+            arena = NULL;
+        }
+    }
+
+    GeometryArena::GeometryArena(const VertexFormat& format)
+        : format(format), ranges(0) {
+    }
+
+    GeometryArena& GeometryArena::shared() {
+        //never destroyed, so meshes in globals can still give their ranges back at exit
+        static GeometryArena* arena = new GeometryArena(StandardVertexFormat());
+        return *arena;
+    }
+
+    GeometryArena& GeometryArena::quantized() {
+        static GeometryArena* arena = new GeometryArena(QuantizedVertexFormat());
+        return *arena;
+    }
+
+    GeometryRange GeometryArena::allocate(const void* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount) {
+        GeometryRange range;
+        if (vertexCount == 0 || indexCount == 0) {
+            return range;
+        }
+
+        size_t firstVertex = 0;
+        size_t firstIndex = 0;
+        if (!vertexSpace.allocate(vertexCount, &firstVertex)) {
+            reserve(GrownCapacity(vertexSpace.capacity(), vertexCount, MIN_VERTEX_CAPACITY), 0);
+            vertexSpace.allocate(vertexCount, &firstVertex);
+        }
+        if (!indexSpace.allocate(indexCount, &firstIndex)) {
+            reserve(0, GrownCapacity(indexSpace.capacity(), indexCount, MIN_INDEX_CAPACITY));
+            indexSpace.allocate(indexCount, &firstIndex);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(firstVertex * format.stride),
+                        (GLsizeiptr)(vertexCount * format.stride), vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(firstIndex * sizeof(GLuint)),
+                        (GLsizeiptr)(indexCount * sizeof(GLuint)), indexData);
+
+        range.arena = this;
+        range.firstVertex = firstVertex;
+        range.vertices = vertexCount;
+        range.indexOffset = firstIndex;
+        range.indices = indexCount;
+        ranges++;
+        return range;
+    }
+
+    void GeometryArena::free(GeometryRange& range) {
+        vertexSpace.free(range.firstVertex, range.vertices);
+        indexSpace.free(range.indexOffset, range.indices);
+        ranges--;
+    }
+
+    void GeometryArena::reserve(size_t vertexCapacity, size_t indexCapacity) {
+        if (vertexCapacity > vertexSpace.capacity()) {
+            vbo = GrowBuffer(vbo, vertexSpace.capacity() * format.stride, vertexCapacity * format.stride);
+            vertexSpace.grow(vertexCapacity);
+        }
+        if (indexCapacity > indexSpace.capacity()) {
+            ebo = GrowBuffer(ebo, indexSpace.capacity() * sizeof(GLuint), indexCapacity * sizeof(GLuint));
+            indexSpace.grow(indexCapacity);
+        }
+        setupVertexArray();
+    }
+
+    // Points the VAO at the current buffers, after every reallocation
+    void GeometryArena::setupVertexArray() {
+        if (!vao) {
+            vao = VertexArrayHandle::create();
+        }
+
+        RenderState& state = RenderState::current();
+        state.bindVertexArray(vao.get());
+
+        ApplyVertexFormat(format, vbo.get());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.get());
+
+        //so later element buffer binds cannot end up in this VAO
+        state.bindVertexArray(0);
+    }
+
+    GLuint GeometryArena::vertexArray() const {
+        return vao.get();
+    }
+
+    GLuint GeometryArena::vertexBuffer() const {
+        return vbo.get();
+    }
+
+    GLuint GeometryArena::indexBuffer() const {
+        return ebo.get();
+    }
+
+    const VertexFormat& GeometryArena::getFormat() const {
+        return format;
+    }
+
+    bool GeometryArena::releaseBuffers() {
+        if (ranges > 0) {
+            return false;
+        }
+
+        vao.reset();
+        vbo.reset();
+        ebo.reset();
+        vertexSpace = RangeAllocator();
+        indexSpace = RangeAllocator();
+        return true;
+    }
+
+    GeometryArenaStats GeometryArena::stats() const {
+        GeometryArenaStats stats;
+        stats.vertexCapacity = vertexSpace.capacity();
+        stats.verticesUsed = vertexSpace.used();
+        stats.indexCapacity = indexSpace.capacity();
+        stats.indicesUsed = indexSpace.used();
+        stats.ranges = ranges;
+        return stats;
+    }
+}
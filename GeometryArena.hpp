@@ -0,0 +1,146 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    // First-fit allocator of ranges in [0, capacity), merging neighbouring free ranges
+    class RangeAllocator {
+
+    public:
+        RangeAllocator();
+
+        // Returns false when no free range is large enough
+        bool allocate(size_t size, size_t* offset);
+        void free(size_t offset, size_t size);
+
+        // Appends [capacity, newCapacity) to the free space
+        void grow(size_t newCapacity);
+
+        size_t capacity() const;
+        size_t used() const;
+
+    private:
+        //offset -> size of every free range
+        std::map<size_t, size_t> freeRanges;
+        size_t total;
+        size_t allocated;
+    };
+
+    struct VertexAttribute {
+        GLuint location;
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        size_t offset;
+    };
+
+    struct VertexFormat {
+        GLsizei stride;
+        std::vector<VertexAttribute> attributes;
+    };
+
+    // Layout of gps::Vertex: position, normal and texture coordinates at locations 0, 1 and 2
+    VertexFormat StandardVertexFormat();
+
+    // Enables the format's attributes on the bound VAO, reading from vertexBuffer
+    void ApplyVertexFormat(const VertexFormat& format, GLuint vertexBuffer);
+
+    struct GeometryArenaStats {
+        size_t vertexCapacity;
+        size_t verticesUsed;
+        size_t indexCapacity;
+        size_t indicesUsed;
+        size_t ranges;
+    };
+
+    class GeometryArena;
+
+    // The vertices and indices of one mesh inside a GeometryArena, given back to
+    // the arena with the range. Moved, never copied.
+    class GeometryRange {
+
+    public:
+        GeometryRange();
+        ~GeometryRange();
+
+        GeometryRange(GeometryRange&& other) noexcept;
+        GeometryRange& operator=(GeometryRange&& other) noexcept;
+        GeometryRange(const GeometryRange&) = delete;
+        GeometryRange& operator=(const GeometryRange&) = delete;
+
+        GeometryArena* getArena() const { return arena; }
+        // Added to every index by glDrawElementsBaseVertex
+        GLint baseVertex() const { return (GLint)firstVertex; }
+        GLuint firstIndex() const { return (GLuint)indexOffset; }
+        GLsizei indexCount() const { return (GLsizei)indices; }
+        size_t vertexCount() const { return vertices; }
+
+        void reset();
+
+    private:
+        friend class GeometryArena;
+
+        GeometryArena* arena;
+        size_t firstVertex;
+        size_t vertices;
+        size_t indexOffset;
+        size_t indices;
+    };
+
+    // One vertex buffer and one index buffer shared by every mesh of a vertex
+    // format, with a single VAO describing them. Meshes draw their range with
+    // glDrawElementsBaseVertex, so switching between them binds nothing. When
+    // full, the buffers are reallocated at twice the size and the old contents
+    // copied over on the GPU; ranges keep their offsets.
+    //
+    // GL thread only, like everything else touching GL objects.
+    class GeometryArena {
+
+    public:
+        explicit GeometryArena(const VertexFormat& format);
+
+        // Arena of gps::Vertex meshes. It lives for the whole process; call
+        // releaseBuffers() before the GL context goes away.
+        static GeometryArena& shared();
+        // The same for gps::QuantizedVertex meshes
+        static GeometryArena& quantized();
+
+        // Copies the vertices (format.stride bytes each) and indices into the arena
+        GeometryRange allocate(const void* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+        GLuint vertexArray() const;
+        GLuint vertexBuffer() const;
+        GLuint indexBuffer() const;
+        const VertexFormat& getFormat() const;
+
+        // Deletes the GL objects once every range is gone; returns false, keeping
+        // them, while ranges are still allocated. The next allocation recreates them.
+        bool releaseBuffers();
+
+        GeometryArenaStats stats() const;
+
+    private:
+        friend class GeometryRange;
+
+        VertexFormat format;
+        VertexArrayHandle vao;
+        BufferHandle vbo;
+        BufferHandle ebo;
+        RangeAllocator vertexSpace;
+        RangeAllocator indexSpace;
+        size_t ranges;
+
+        void free(GeometryRange& range);
+        // Grows the buffers to hold at least the given number of vertices and indices
+        void reserve(size_t vertexCapacity, size_t indexCapacity);
+        void setupVertexArray();
+    };
+}
+
+#endif /* GeometryArena_hpp */
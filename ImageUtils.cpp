@@ -0,0 +1,78 @@
+#include "ImageUtils.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_SWAP_SSE2
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+    #include <arm_neon.h>
+    #define GPS_SWAP_NEON
+#endif
+
+namespace gps {
+
+    void SwapBytes(unsigned char* a, unsigned char* b, size_t count) {
+        size_t i = 0;
+
+#if defined (GPS_SWAP_SSE2)
+        for (; i + 64 <= count; i += 64) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(a + i + 16));
+            __m128i a2 = _mm_loadu_si128((const __m128i*)(a + i + 32));
+            __m128i a3 = _mm_loadu_si128((const __m128i*)(a + i + 48));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(b + i));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(b + i + 16));
+            __m128i b2 = _mm_loadu_si128((const __m128i*)(b + i + 32));
+            __m128i b3 = _mm_loadu_si128((const __m128i*)(b + i + 48));
+            _mm_storeu_si128((__m128i*)(a + i), b0);
+            _mm_storeu_si128((__m128i*)(a + i + 16), b1);
+            _mm_storeu_si128((__m128i*)(a + i + 32), b2);
+            _mm_storeu_si128((__m128i*)(a + i + 48), b3);
+            _mm_storeu_si128((__m128i*)(b + i), a0);
+            _mm_storeu_si128((__m128i*)(b + i + 16), a1);
+            _mm_storeu_si128((__m128i*)(b + i + 32), a2);
+            _mm_storeu_si128((__m128i*)(b + i + 48), a3);
+        }
+        for (; i + 16 <= count; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            _mm_storeu_si128((__m128i*)(a + i), vb);
+            _mm_storeu_si128((__m128i*)(b + i), va);
+        }
+#elif defined (GPS_SWAP_NEON)
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t va = vld1q_u8(a + i);
+            uint8x16_t vb = vld1q_u8(b + i);
+            vst1q_u8(a + i, vb);
+            vst1q_u8(b + i, va);
+        }
+#endif
+
+        //8 bytes at a time, memcpy keeps unaligned access legal
+        for (; i + 8 <= count; i += 8) {
+            uint64_t va, vb;
+            memcpy(&va, a + i, 8);
+            memcpy(&vb, b + i, 8);
+            memcpy(a + i, &vb, 8);
+            memcpy(b + i, &va, 8);
+        }
+
+        for (; i < count; i++) {
+            unsigned char temp = a[i];
+            a[i] = b[i];
+            b[i] = temp;
+        }
+    }
+
+    void FlipRowsVertically(unsigned char* pixels, int width, int height, int bytesPerPixel) {
+        size_t rowBytes = (size_t)width * (size_t)bytesPerPixel;
+
+        for (int row = 0; row < height / 2; row++) {
+            unsigned char* top = pixels + (size_t)row * rowBytes;
+            unsigned char* bottom = pixels + (size_t)(height - row - 1) * rowBytes;
+            SwapBytes(top, bottom, rowBytes);
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef ImageUtils_hpp
+#define ImageUtils_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Mirrors an image upside down in place by swapping whole rows,
+    // 16 bytes at a time where SSE2 or NEON is available
+    void FlipRowsVertically(unsigned char* pixels, int width, int height, int bytesPerPixel);
+
+    // Swaps two non-overlapping byte ranges of the same length
+    void SwapBytes(unsigned char* a, unsigned char* b, size_t count);
+}
+
+#endif /* ImageUtils_hpp */
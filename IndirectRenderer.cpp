@@ -0,0 +1,363 @@
+#include "IndirectRenderer.hpp"
+#include "RenderState.hpp"
+#include "UniformBlocks.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace gps {
+
+    namespace {
+
+        // Attribute location of the draw id in shaders/indirect.vert
+        const GLuint DRAW_ID_LOCATION = 3;
+        // Shader storage binding of the DrawTransforms block
+        const GLuint TRANSFORM_BINDING = 0;
+        // Three frames of 4096 draws, command and transform each
+        const size_t INDIRECT_STREAM_CAPACITY = 3 * 4096 * (sizeof(DrawElementsIndirectCommand) + 2 * sizeof(glm::mat4));
+    }
+
+    bool IndirectRenderer::BatchKey::operator<(const BatchKey& other) const {
+        if (arena != other.arena) {
+            return arena < other.arena;
+        }
+        return textures < other.textures;
+    }
+
+    IndirectRenderer::IndirectRenderer()
+        : stream(INDIRECT_STREAM_CAPACITY), storageAlignment(0), drawIdCapacity(0), meshletCulling(true) {
+        lastStats.draws = 0;
+        lastStats.batches = 0;
+        lastStats.triangles = 0;
+        lastStats.indirect = false;
+        lastStats.meshlets.tested = 0;
+        lastStats.meshlets.frustumCulled = 0;
+        lastStats.meshlets.backfaceCulled = 0;
+    }
+
+    bool IndirectRenderer::isSupported() {
+#if defined (__APPLE__)
+        //macOS stops at GL 4.1
+        return false;
+#else
+        return GLEW_VERSION_4_3 != 0;
+#endif
+    }
+
+    void IndirectRenderer::submit(Model3D& model, const glm::mat4& transform) {
+        Submission submission;
+        submission.model = &model;
+        submission.transform = transform;
+        submission.selectLods = false;
+        submissions.push_back(submission);
+    }
+
+    void IndirectRenderer::submit(Model3D& model, const glm::mat4& transform, const LodSelection& selection) {
+        Submission submission;
+        submission.model = &model;
+        submission.transform = transform;
+        submission.selectLods = true;
+        submission.lodSelection = selection;
+        submissions.push_back(submission);
+    }
+
+    void IndirectRenderer::flush(const Shader& indirectShader, const Shader& fallbackShader) {
+        prepareCulling();
+        if (isSupported() && indirectShader.shaderProgram != 0) {
+            flushIndirect(indirectShader);
+        } else {
+            flushLoop(fallbackShader);
+        }
+        submissions.clear();
+    }
+
+    IndirectRendererStats IndirectRenderer::stats() const {
+        return lastStats;
+    }
+
+    StreamBufferStats IndirectRenderer::streamStats() const {
+        return stream.stats();
+    }
+
+    void IndirectRenderer::releaseBuffers() {
+        bindings.clear();
+        stream.releaseBuffers();
+        drawIdBuffer.reset();
+        drawIdCapacity = 0;
+    }
+
+    // Sorts the submitted meshes into batches, filling one transform per mesh
+    // and one command per visible range of it, with the meshes of a batch next
+    // to each other
+    void IndirectRenderer::buildBatches(const Shader& shader) {
+        batches.clear();
+        std::map<BatchKey, size_t> batchIndex;
+        //batch of every mesh, in submission order
+        std::vector<size_t> meshBatch;
+
+        BatchKey key;
+        for (size_t s = 0; s < submissions.size(); s++) {
+            std::vector<Mesh>& meshes = submissions[s].model->getMeshes();
+            for (size_t m = 0; m < meshes.size(); m++) {
+                Mesh& mesh = meshes[m];
+                key.arena = mesh.getGeometry().getArena();
+                if (key.arena == NULL) {
+                    continue;
+                }
+
+                //every sampler unit of the program, 0 where the mesh has no texture
+                key.textures = mesh.getTextureBindings(shader);
+
+                std::map<BatchKey, size_t>::iterator found = batchIndex.find(key);
+                if (found == batchIndex.end()) {
+                    Batch batch = { key, 0, 0, 0, 0 };
+                    found = batchIndex.insert(std::make_pair(key, batches.size())).first;
+                    batches.push_back(batch);
+                }
+                batches[found->second].count++;
+                meshBatch.push_back(found->second);
+            }
+        }
+
+        size_t first = 0;
+        for (size_t b = 0; b < batches.size(); b++) {
+            batches[b].first = first;
+            first += batches[b].count;
+        }
+        transforms.resize(first);
+        draws.resize(first);
+
+        //the next free slot of every batch
+        std::vector<size_t> slots(batches.size());
+        for (size_t b = 0; b < batches.size(); b++) {
+            slots[b] = batches[b].first;
+        }
+
+        //normals go straight to eye space in indirect.vert
+        const glm::mat4& view = UniformBlocks::shared().frame().view;
+        size_t drawn = 0;
+        for (size_t s = 0; s < submissions.size(); s++) {
+            const glm::mat4& transform = submissions[s].transform;
+            glm::mat4 normalMatrix = glm::inverseTranspose(view * transform);
+
+            const std::vector<Mesh>& meshes = submissions[s].model->getMeshes();
+            for (size_t m = 0; m < meshes.size(); m++) {
+                if (meshes[m].getGeometry().getArena() == NULL) {
+                    continue;
+                }
+
+                size_t slot = slots[meshBatch[drawn++]]++;
+                draws[slot].mesh = &meshes[m];
+                draws[slot].submission = s;
+
+                //quantized positions are decoded before the model matrix applies
+                const glm::mat4* decode = meshes[m].getPositionDecode();
+                transforms[slot].model = decode ? transform * *decode : transform;
+                transforms[slot].normalMatrix = normalMatrix;
+            }
+        }
+
+        //every command of a mesh reads its transform through baseInstance
+        commands.clear();
+        lastStats.triangles = 0;
+        for (size_t b = 0; b < batches.size(); b++) {
+            batches[b].firstCommand = commands.size();
+            for (size_t slot = batches[b].first; slot < batches[b].first + batches[b].count; slot++) {
+                const Mesh& mesh = *draws[slot].mesh;
+                const GeometryRange& geometry = mesh.getGeometry();
+                ranges.clear();
+                rangesOf(draws[slot].submission, mesh, ranges);
+
+                for (size_t r = 0; r < ranges.size(); r++) {
+                    DrawElementsIndirectCommand command;
+                    command.count = ranges[r].indexCount;
+                    command.instanceCount = 1;
+                    command.firstIndex = geometry.firstIndex() + ranges[r].firstIndex;
+                    command.baseVertex = geometry.baseVertex();
+                    command.baseInstance = (GLuint)slot;
+                    commands.push_back(command);
+                    lastStats.triangles += ranges[r].indexCount / 3;
+                }
+            }
+            batches[b].commandCount = commands.size() - batches[b].firstCommand;
+        }
+    }
+
+    void IndirectRenderer::flushIndirect(const Shader& shader) {
+#if !defined (__APPLE__)
+        buildBatches(shader);
+
+        lastStats.draws = commands.size();
+        lastStats.batches = batches.size();
+        lastStats.indirect = true;
+        if (commands.empty()) {
+            return;
+        }
+
+        if (storageAlignment == 0) {
+            GLint alignment = 0;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            storageAlignment = alignment > 0 ? (size_t)alignment : 1;
+        }
+        size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        size_t transformBytes = transforms.size() * sizeof(DrawTransform);
+
+        size_t transformOffset = stream.write(&transforms[0], transformBytes, storageAlignment);
+        GLuint transformBuffer = stream.buffer();
+        size_t commandOffset = stream.write(&commands[0], commandBytes, sizeof(GLuint));
+        if (stream.buffer() != transformBuffer) {
+            //the commands did not fit and the stream was reallocated, taking the transforms with it
+            transformOffset = stream.write(&transforms[0], transformBytes, storageAlignment);
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer());
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, TRANSFORM_BINDING, stream.buffer(),
+                          (GLintptr)transformOffset, (GLsizeiptr)transformBytes);
+
+        //commands pick their id by transform slot, and culled meshes keep theirs
+        reserveDrawIds(transforms.size());
+
+        RenderState& state = RenderState::current();
+        state.useProgram(shader.shaderProgram);
+
+        for (size_t b = 0; b < batches.size(); b++) {
+            const Batch& batch = batches[b];
+            for (size_t i = 0; i < batch.key.textures.size(); i++) {
+                state.bindTexture(batch.key.textures[i].first, batch.key.textures[i].second);
+            }
+            bindArena(batch.key.arena);
+
+            if (batch.commandCount == 0) {
+                //every meshlet culled
+                continue;
+            }
+            state.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                            (const void*)(commandOffset + batch.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                            (GLsizei)batch.commandCount);
+        }
+        stream.fence();
+#else
+        flushLoop(shader);
+#endif
+    }
+
+    void IndirectRenderer::flushLoop(const Shader& shader) {
+        lastStats.draws = 0;
+        lastStats.batches = 0;
+        lastStats.triangles = 0;
+        lastStats.indirect = false;
+
+        UniformBlocks& blocks = UniformBlocks::shared();
+        for (size_t s = 0; s < submissions.size(); s++) {
+            blocks.setObject(blocks.objectUniforms(submissions[s].transform));
+
+            std::vector<Mesh>& meshes = submissions[s].model->getMeshes();
+            for (size_t m = 0; m < meshes.size(); m++) {
+                ranges.clear();
+                rangesOf(s, meshes[m], ranges);
+                if (ranges.empty()) {
+                    continue;
+                }
+
+                meshes[m].DrawRanges(shader, &ranges[0], ranges.size());
+                for (size_t r = 0; r < ranges.size(); r++) {
+                    lastStats.triangles += ranges[r].indexCount / 3;
+                }
+                lastStats.draws += ranges.size();
+                lastStats.batches++;
+            }
+        }
+    }
+
+    // Frustum and camera of every submission in its model space, for the meshlet culling
+    void IndirectRenderer::prepareCulling() {
+        lastStats.meshlets.tested = 0;
+        lastStats.meshlets.frustumCulled = 0;
+        lastStats.meshlets.backfaceCulled = 0;
+        cullViews.clear();
+        if (!meshletCulling) {
+            return;
+        }
+
+        const FrameUniforms& frame = UniformBlocks::shared().frame();
+        glm::vec4 camera = glm::inverse(frame.view)[3];
+        cullViews.resize(submissions.size());
+        for (size_t s = 0; s < submissions.size(); s++) {
+            const glm::mat4& transform = submissions[s].transform;
+            cullViews[s].frustum = ExtractFrustum(frame.viewProjection * transform);
+            cullViews[s].cameraPosition = glm::vec3(glm::inverse(transform) * camera);
+        }
+    }
+
+    // The index ranges of a mesh to draw: its level of detail whole, or the
+    // visible meshlets of the full mesh
+    void IndirectRenderer::rangesOf(size_t submission, const Mesh& mesh, std::vector<IndexRange>& visible) {
+        size_t lod = lodOf(submissions[submission], mesh);
+        if (lod == 0 && !cullViews.empty() && !mesh.getMeshlets().empty()) {
+            const CullView& view = cullViews[submission];
+            CullMeshlets(mesh.getMeshlets(), view.frustum, view.cameraPosition, visible, lastStats.meshlets);
+            return;
+        }
+
+        const MeshLod& level = mesh.getLod(lod);
+        IndexRange range = { level.firstIndex, level.indexCount };
+        visible.push_back(range);
+    }
+
+    void IndirectRenderer::setMeshletCulling(bool enabled) {
+        meshletCulling = enabled;
+    }
+
+    size_t IndirectRenderer::lodOf(const Submission& submission, const Mesh& mesh) {
+        return submission.selectLods ? mesh.selectLod(submission.transform, submission.lodSelection) : 0;
+    }
+
+    // Grows the draw id buffer to hold at least count ids, in powers of two
+    void IndirectRenderer::reserveDrawIds(size_t count) {
+        if (count <= drawIdCapacity) {
+            return;
+        }
+
+        size_t capacity = drawIdCapacity > 0 ? drawIdCapacity : 256;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        std::vector<GLuint> ids(capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            ids[i] = (GLuint)i;
+        }
+
+        //a new buffer, so the VAOs still pointing at the old one get rebuilt
+        drawIdBuffer = BufferHandle::create();
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer.get());
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(capacity * sizeof(GLuint)), &ids[0], GL_STATIC_DRAW);
+        drawIdBuffer.setBytes(capacity * sizeof(GLuint));
+        drawIdCapacity = capacity;
+    }
+
+    // Binds a VAO reading the arena's geometry and the draw ids, rebuilding it
+    // when the arena has reallocated its buffers
+    void IndirectRenderer::bindArena(GeometryArena* arena) {
+        RenderState& state = RenderState::current();
+        ArenaBinding& binding = bindings[arena];
+
+        if (!binding.vao || binding.vertexBuffer != arena->vertexBuffer() ||
+            binding.indexBuffer != arena->indexBuffer() || binding.drawIdBuffer != drawIdBuffer.get()) {
+
+            binding.vao = VertexArrayHandle::create();
+            state.bindVertexArray(binding.vao.get());
+
+            ApplyVertexFormat(arena->getFormat(), arena->vertexBuffer());
+            glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer.get());
+            glEnableVertexAttribArray(DRAW_ID_LOCATION);
+            glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, (const GLvoid*)0);
+            glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->indexBuffer());
+
+            binding.vertexBuffer = arena->vertexBuffer();
+            binding.indexBuffer = arena->indexBuffer();
+            binding.drawIdBuffer = drawIdBuffer.get();
+        }
+
+        state.bindVertexArray(binding.vao.get());
+    }
+}
@@ -0,0 +1,163 @@
+#ifndef IndirectRenderer_hpp
+#define IndirectRenderer_hpp
+
+#include "Model3D.hpp"
+#include "GeometryArena.hpp"
+#include "GLHandle.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // One entry of a GL_DRAW_INDIRECT_BUFFER, as glMultiDrawElementsIndirect reads it
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct IndirectRendererStats {
+        size_t draws;
+        //glMultiDrawElementsIndirect calls, or meshes drawn one by one on the fallback path
+        size_t batches;
+        //at the levels of detail drawn, after meshlet culling
+        size_t triangles;
+        MeshletCullStats meshlets;
+        bool indirect;
+    };
+
+    // Draws Model3D scenes with one glMultiDrawElementsIndirect per batch of
+    // meshes sharing a geometry arena and a set of textures. The model and normal
+    // matrix of each draw sit in a shader storage buffer that shaders/indirect.vert
+    // indexes by draw id; the id comes from an instanced attribute, advanced by
+    // each command's baseInstance, so GL 4.3 is enough.
+    //
+    // Meshes drawn at full detail that have meshlets are culled cluster by
+    // cluster against the frame's view: only the visible index ranges get a
+    // command, with neighbouring meshlets merged.
+    //
+    // Without GL 4.3 (always on macOS) flush() falls back to drawing the models
+    // one by one, writing an ObjectUniforms block for each and drawing the
+    // visible ranges with glMultiDrawElementsBaseVertex.
+    class IndirectRenderer {
+
+    public:
+        IndirectRenderer();
+
+        static bool isSupported();
+
+        // Queues every mesh of the model with the given model matrix; the model
+        // must stay alive until the next flush
+        void submit(Model3D& model, const glm::mat4& transform);
+        // The same, drawing each mesh at the level of detail the selection picks
+        void submit(Model3D& model, const glm::mat4& transform, const LodSelection& selection);
+
+        // Draws and forgets everything submitted, between UniformBlocks'
+        // beginFrame() and endFrame(). indirectShader is built from
+        // shaders/indirect.vert and may be empty where GL 4.3 is missing.
+        void flush(const Shader& indirectShader, const Shader& fallbackShader);
+
+        // On by default
+        void setMeshletCulling(bool enabled);
+
+        // What the last flush did
+        IndirectRendererStats stats() const;
+        StreamBufferStats streamStats() const;
+
+        // Deletes the renderer's GL objects, before the context goes away
+        void releaseBuffers();
+
+    private:
+        struct Submission {
+            Model3D* model;
+            glm::mat4 transform;
+            //level 0 for every mesh otherwise
+            bool selectLods;
+            LodSelection lodSelection;
+        };
+
+        // Per draw, std430 layout of DrawTransform in indirect.vert
+        struct DrawTransform {
+            glm::mat4 model;
+            //inverse transpose of view * model, eye space normals
+            glm::mat4 normalMatrix;
+        };
+
+        struct BatchKey {
+            GeometryArena* arena;
+            //(texture unit, texture) for every sampler unit of the program
+            std::vector<std::pair<GLint, GLuint> > textures;
+
+            bool operator<(const BatchKey& other) const;
+        };
+
+        struct Batch {
+            BatchKey key;
+            //transforms, one per mesh
+            size_t first;
+            size_t count;
+            //commands, one per visible range
+            size_t firstCommand;
+            size_t commandCount;
+        };
+
+        // The mesh behind each transform slot
+        struct DrawRecord {
+            const Mesh* mesh;
+            size_t submission;
+        };
+
+        // A submission's frustum and camera, in its model space
+        struct CullView {
+            Frustum frustum;
+            glm::vec3 cameraPosition;
+        };
+
+        // A VAO reading an arena's buffers plus the draw id attribute
+        struct ArenaBinding {
+            VertexArrayHandle vao;
+            GLuint vertexBuffer;
+            GLuint indexBuffer;
+            GLuint drawIdBuffer;
+        };
+
+        std::vector<Submission> submissions;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<DrawTransform> transforms;
+        std::vector<Batch> batches;
+        std::vector<DrawRecord> draws;
+        std::vector<CullView> cullViews;
+        //scratch for rangesOf()
+        std::vector<IndexRange> ranges;
+
+        //draw commands and transforms, rewritten every flush
+        StreamBuffer stream;
+        //GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, 0 until queried
+        size_t storageAlignment;
+        //0, 1, 2, ... read once per draw through baseInstance
+        BufferHandle drawIdBuffer;
+        size_t drawIdCapacity;
+        std::map<GeometryArena*, ArenaBinding> bindings;
+        bool meshletCulling;
+
+        IndirectRendererStats lastStats;
+
+        void buildBatches(const Shader& shader);
+        void flushIndirect(const Shader& shader);
+        void flushLoop(const Shader& shader);
+        void prepareCulling();
+        void rangesOf(size_t submission, const Mesh& mesh, std::vector<IndexRange>& visible);
+        void reserveDrawIds(size_t count);
+        void bindArena(GeometryArena* arena);
+        static size_t lodOf(const Submission& submission, const Mesh& mesh);
+    };
+}
+
+#endif /* IndirectRenderer_hpp */
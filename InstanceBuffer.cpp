@@ -0,0 +1,74 @@
+#include "InstanceBuffer.hpp"
+#include "RenderState.hpp"
+
+namespace gps {
+
+    namespace {
+
+        // First of the four vec4 attribute locations holding the instance's model matrix
+        const GLuint INSTANCE_MODEL_LOCATION = 3;
+        // Three frames of 16K instances
+        const size_t INSTANCE_STREAM_CAPACITY = 3 * 16384 * sizeof(glm::mat4);
+    }
+
+    InstanceBuffer::InstanceBuffer()
+        : stream(INSTANCE_STREAM_CAPACITY), offset(0) {
+    }
+
+    InstanceBuffer& InstanceBuffer::shared() {
+        static InstanceBuffer instances;
+        return instances;
+    }
+
+    void InstanceBuffer::upload(const glm::mat4* transforms, size_t count) {
+        offset = stream.write(transforms, count * sizeof(glm::mat4), sizeof(glm::mat4));
+    }
+
+    GLuint InstanceBuffer::vertexArray(GeometryArena* arena) {
+        RenderState& state = RenderState::current();
+        ArenaBinding& binding = bindings[arena];
+
+        if (!binding.vao || binding.vertexBuffer != arena->vertexBuffer() || binding.indexBuffer != arena->indexBuffer()) {
+
+            binding.vao = VertexArrayHandle::create();
+            state.bindVertexArray(binding.vao.get());
+
+            ApplyVertexFormat(arena->getFormat(), arena->vertexBuffer());
+            for (GLuint column = 0; column < 4; column++) {
+                glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+                glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+            }
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->indexBuffer());
+
+            binding.vertexBuffer = arena->vertexBuffer();
+            binding.indexBuffer = arena->indexBuffer();
+            binding.instanceBuffer = 0;
+        }
+
+        state.bindVertexArray(binding.vao.get());
+        if (binding.instanceBuffer != stream.buffer() || binding.instanceOffset != offset) {
+
+            glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+            for (GLuint column = 0; column < 4; column++) {
+                glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                      (const GLvoid*)(offset + column * sizeof(glm::vec4)));
+            }
+            binding.instanceBuffer = stream.buffer();
+            binding.instanceOffset = offset;
+        }
+        return binding.vao.get();
+    }
+
+    void InstanceBuffer::fence() {
+        stream.fence();
+    }
+
+    StreamBufferStats InstanceBuffer::stats() const {
+        return stream.stats();
+    }
+
+    void InstanceBuffer::releaseBuffers() {
+        bindings.clear();
+        stream.releaseBuffers();
+    }
+}
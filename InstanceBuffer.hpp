@@ -0,0 +1,62 @@
+#ifndef InstanceBuffer_hpp
+#define InstanceBuffer_hpp
+
+#include "GeometryArena.hpp"
+#include "GLHandle.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <map>
+
+namespace gps {
+
+    // Per-instance model matrices for glDrawElementsInstanced, read by
+    // shaders/instanced.vert at attribute locations 3 to 6 with a divisor of 1.
+    // Each arena gets a second VAO reading its geometry plus the stream the
+    // matrices are written to, so instanced draws leave the arena's own VAO
+    // alone. The instance attributes are pointed at each upload's offset.
+    //
+    // GL thread only; call releaseBuffers() before the GL context goes away.
+    class InstanceBuffer {
+
+    public:
+        InstanceBuffer();
+
+        static InstanceBuffer& shared();
+
+        // Writes the matrices read by the next draws into the stream
+        void upload(const glm::mat4* transforms, size_t count);
+
+        // VAO reading the arena's vertices and indices plus the matrices uploaded
+        // last, rebuilt when the arena has reallocated its buffers
+        GLuint vertexArray(GeometryArena* arena);
+
+        // Call after the draws reading the uploaded matrices
+        void fence();
+
+        StreamBufferStats stats() const;
+
+        void releaseBuffers();
+
+    private:
+        struct ArenaBinding {
+            VertexArrayHandle vao;
+            GLuint vertexBuffer;
+            GLuint indexBuffer;
+            GLuint instanceBuffer;
+            //where the instance attributes point in instanceBuffer
+            size_t instanceOffset;
+        };
+
+        StreamBuffer stream;
+        //of the last upload
+        size_t offset;
+        std::map<GeometryArena*, ArenaBinding> bindings;
+
+        InstanceBuffer(const InstanceBuffer&);
+        InstanceBuffer& operator=(const InstanceBuffer&);
+    };
+}
+
+#endif /* InstanceBuffer_hpp */
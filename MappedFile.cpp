@@ -0,0 +1,153 @@
+#include "MappedFile.hpp"
+
+#if defined (_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace gps {
+
+    MappedFile::MappedFile()
+        : bytes(NULL), length(0), opened(false) {
+
+#if defined (_WIN32)
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = NULL;
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#if defined (_WIN32)
+
+    bool MappedFile::open(const std::string& fileName) {
+        close();
+
+        HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            return false;
+        }
+
+        fileHandle = file;
+        length = (size_t)fileSize.QuadPart;
+        opened = true;
+
+        //an empty file cannot be mapped, but it is still a valid (empty) view
+        if (length == 0) {
+            return true;
+        }
+
+        mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            close();
+            return false;
+        }
+
+        bytes = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (bytes == NULL) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (bytes) {
+            UnmapViewOfFile(bytes);
+        }
+        if (mappingHandle) {
+            CloseHandle(mappingHandle);
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle(fileHandle);
+        }
+
+        bytes = NULL;
+        length = 0;
+        opened = false;
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+
+#else
+
+    bool MappedFile::open(const std::string& fileName) {
+        close();
+
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        length = (size_t)fileInfo.st_size;
+        opened = true;
+
+        //an empty file cannot be mapped, but it is still a valid (empty) view
+        if (length == 0) {
+            ::close(fd);
+            return true;
+        }
+
+        void* address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        //the mapping keeps its own reference to the file
+        ::close(fd);
+
+        if (address == MAP_FAILED) {
+            length = 0;
+            opened = false;
+            return false;
+        }
+
+        //the parsers walk the file front to back
+        madvise(address, length, MADV_SEQUENTIAL);
+
+        bytes = (const char*)address;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (bytes) {
+            munmap((void*)bytes, length);
+        }
+
+        bytes = NULL;
+        length = 0;
+        opened = false;
+    }
+
+#endif
+
+    bool MappedFile::isOpen() const {
+        return opened;
+    }
+
+    const char* MappedFile::data() const {
+        return bytes;
+    }
+
+    size_t MappedFile::size() const {
+        return length;
+    }
+}
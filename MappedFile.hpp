@@ -0,0 +1,40 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only view of a whole file mapped into the address space.
+    // The bytes are not NUL-terminated; always bound reads by size().
+    class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        //returns false if the file cannot be opened or mapped
+        bool open(const std::string& fileName);
+        void close();
+
+        bool isOpen() const;
+        const char* data() const;
+        size_t size() const;
+
+    private:
+        const char* bytes;
+        size_t length;
+        bool opened;
+
+#if defined (_WIN32)
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+}
+
+#endif /* MappedFile_hpp */
@@ -1,72 +1,277 @@
 #include "Mesh.hpp"
+#include "RenderState.hpp"
+#include "InstanceBuffer.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <utility>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+			   MeshResidency residency, const QuantizedMesh* quantized, std::vector<MeshLod> lods, const Bounds* bounds) {
+
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->unitsProgram = 0;
+
+		this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), quantized,
+						std::move(lods), bounds);
+
+		if (residency == MESH_KEEP_POSITIONS) {
+
+			this->keepPositions(this->vertices.data(), this->vertices.size());
+		}
+		//swapping with an empty vector gives the memory back, clear() would keep it
+		if (residency != MESH_KEEP_CPU_COPY) {
+
+			std::vector<Vertex>().swap(this->vertices);
+		}
+		if (residency == MESH_GPU_ONLY) {
 
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+			std::vector<GLuint>().swap(this->indices);
+		} else if (this->lods.size() > 1) {
 
-		this->setupMesh();
+			//picking and physics want the full mesh only
+			std::vector<GLuint>(this->indices.begin(), this->indices.begin() + this->lods[0].indexCount).swap(this->indices);
+		}
 	}
 
-	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	Mesh::Mesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Texture> textures,
+			   MeshResidency residency, const QuantizedMesh* quantized, std::vector<MeshLod> lods, const Bounds* bounds) {
+
+		this->textures = std::move(textures);
+		this->unitsProgram = 0;
+
+		this->setupMesh(vertexData, vertexCount, indexData, indexCount, quantized, std::move(lods), bounds);
+
+		if (residency == MESH_KEEP_CPU_COPY) {
+
+			this->vertices.assign(vertexData, vertexData + vertexCount);
+		} else if (residency == MESH_KEEP_POSITIONS) {
+
+			this->keepPositions(vertexData, vertexCount);
+		}
+		if (residency != MESH_GPU_ONLY) {
+
+			this->indices.assign(indexData, indexData + this->lods[0].indexCount);
+		}
+	}
+
+	Buffers Mesh::getBuffers() const {
+	    Buffers buffers = Buffers();
+	    GeometryArena* arena = this->geometry.getArena();
+	    if (arena) {
+	        buffers.VAO = arena->vertexArray();
+	        buffers.VBO = arena->vertexBuffer();
+	        buffers.EBO = arena->indexBuffer();
+	    }
+	    return buffers;
+	}
+
+	const GeometryRange& Mesh::getGeometry() const {
+	    return this->geometry;
+	}
+
+	const Bounds& Mesh::getBounds() const {
+	    return this->bounds;
+	}
+
+	size_t Mesh::cpuBytes() const {
+	    return this->vertices.capacity() * sizeof(Vertex) + this->positions.capacity() * sizeof(glm::vec3) +
+	           this->indices.capacity() * sizeof(GLuint);
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::Draw(const gps::Shader& shader)	{
+
+		this->Draw(shader, 0);
+	}
+
+	void Mesh::Draw(const gps::Shader& shader, size_t lod) {
+
+		RenderState& state = RenderState::current();
+		this->bindTextures(shader);
+		UniformBlocks::shared().applyPositionDecode(this->getPositionDecode());
+
+		//every mesh of the arena shares its VAO, so this bind is skipped after the first mesh
+		GeometryArena* arena = this->geometry.getArena();
+		if (arena) {
+
+			const MeshLod& level = this->getLod(lod);
+			state.bindVertexArray(arena->vertexArray());
+			state.drawElementsBaseVertex(GL_TRIANGLES, (GLsizei)level.indexCount, GL_UNSIGNED_INT,
+										 (const GLvoid*)((this->geometry.firstIndex() + level.firstIndex) * sizeof(GLuint)),
+										 this->geometry.baseVertex());
+		}
+	}
+
+	void Mesh::DrawRanges(const gps::Shader& shader, const IndexRange* ranges, size_t count) {
+
+		GeometryArena* arena = this->geometry.getArena();
+		if (!arena || count == 0) {
+			return;
+		}
+
+		RenderState& state = RenderState::current();
+		this->bindTextures(shader);
+		UniformBlocks::shared().applyPositionDecode(this->getPositionDecode());
+
+		this->rangeCounts.resize(count);
+		this->rangeOffsets.resize(count);
+		this->rangeBaseVertices.assign(count, this->geometry.baseVertex());
+		for (size_t i = 0; i < count; i++) {
+
+			this->rangeCounts[i] = (GLsizei)ranges[i].indexCount;
+			this->rangeOffsets[i] = (const GLvoid*)((this->geometry.firstIndex() + ranges[i].firstIndex) * sizeof(GLuint));
+		}
+
+		state.bindVertexArray(arena->vertexArray());
+		state.multiDrawElementsBaseVertex(GL_TRIANGLES, &this->rangeCounts[0], GL_UNSIGNED_INT, &this->rangeOffsets[0],
+										  (GLsizei)count, &this->rangeBaseVertices[0]);
+	}
+
+	void Mesh::DrawInstanced(const gps::Shader& shader, GLsizei instanceCount) {
+
+		GeometryArena* arena = this->geometry.getArena();
+		if (!arena || instanceCount <= 0) {
+			return;
+		}
+
+		RenderState& state = RenderState::current();
+		this->bindTextures(shader);
+		UniformBlocks::shared().applyPositionDecode(this->getPositionDecode());
+
+		state.bindVertexArray(InstanceBuffer::shared().vertexArray(arena));
+		state.drawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)this->lods[0].indexCount, GL_UNSIGNED_INT,
+											  (const GLvoid*)(this->geometry.firstIndex() * sizeof(GLuint)),
+											  instanceCount, this->geometry.baseVertex());
+	}
+
+	size_t Mesh::getLodCount() const {
+
+		return this->lods.size();
+	}
+
+	const MeshLod& Mesh::getLod(size_t lod) const {
+
+		return this->lods[std::min(lod, this->lods.size() - 1)];
+	}
 
-		shader.useShaderProgram();
+	size_t Mesh::selectLod(const glm::mat4& model, const LodSelection& selection) const {
 
-		//set textures
-		for (GLuint i = 0; i < textures.size(); i++) {
+		if (this->lods.size() < 2) {
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			return 0;
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		//errors grow with the largest scale of the model matrix
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		BoundingSphere sphere = TransformSphere(this->bounds.sphere, model);
+		float distance = glm::length(selection.cameraPosition - sphere.center) - sphere.radius;
+		if (distance <= 0.0f) {
 
-        for(GLuint i = 0; i < this->textures.size(); i++) {
+			return 0;
+		}
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+		float pixelsPerUnit = selection.projectionScale * scale / distance;
+		for (size_t lod = this->lods.size() - 1; lod > 0; lod--) {
 
-    }
+			if (this->lods[lod].error * pixelsPerUnit <= selection.maxPixelError) {
 
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh() {
+				return lod;
+			}
+		}
+		return 0;
+	}
+
+	void Mesh::setMeshlets(std::vector<Meshlet> meshlets) {
+
+		this->meshlets = std::move(meshlets);
+	}
+
+	const std::vector<Meshlet>& Mesh::getMeshlets() const {
 
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
+		return this->meshlets;
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+	// Uses the program and binds the textures, 0 on the samplers the mesh has no texture for;
+	// whatever is bound already stays bound
+	void Mesh::bindTextures(const gps::Shader& shader) {
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		RenderState& state = RenderState::current();
+		state.useProgram(shader.shaderProgram);
 
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		const std::vector<std::pair<GLint, GLuint> >& bindings = this->getTextureBindings(shader);
+		for (size_t i = 0; i < bindings.size(); i++) {
 
-		glBindVertexArray(0);
+			state.bindTexture(bindings[i].first, bindings[i].second);
+		}
+	}
+
+	const glm::mat4* Mesh::getPositionDecode() const {
+
+		return this->quantized ? &this->positionDecode : NULL;
+	}
+
+	const std::vector<std::pair<GLint, GLuint> >& Mesh::getTextureBindings(const gps::Shader& shader) {
+
+		//sampler units only change with the program, look them up once per switch
+		if (this->unitsProgram != shader.shaderProgram) {
+
+			this->textureBindings.clear();
+			for (GLint unit = 0; unit < shader.samplerUnitCount(); unit++) {
+
+				this->textureBindings.push_back(std::make_pair(unit, (GLuint)0));
+			}
+			for (size_t i = 0; i < this->textures.size(); i++) {
+
+				GLint unit = shader.samplerUnit(this->textures[i].type);
+				if (unit >= 0) {
+
+					this->textureBindings[unit].second = this->textures[i].id;
+				}
+			}
+			this->unitsProgram = shader.shaderProgram;
+		}
+		return this->textureBindings;
+	}
+
+	// Copies the geometry into the shared arena
+	void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+						 const QuantizedMesh* quantizedData, std::vector<MeshLod> lodLevels, const Bounds* knownBounds) {
+
+		this->lods = std::move(lodLevels);
+		if (this->lods.empty()) {
+
+			MeshLod full = { 0, (GLuint)indexCount, 0.0f };
+			this->lods.push_back(full);
+		}
+
+		//loads bring them from ReadOBJ or the mesh cache
+		this->bounds = knownBounds ? *knownBounds : ComputeBounds(vertexData, vertexCount);
+
+		this->quantized = quantizedData != NULL;
+		this->positionDecode = glm::mat4(1.0f);
+		if (quantizedData) {
+
+			this->geometry = GeometryArena::quantized().allocate(quantizedData->vertices.data(), quantizedData->vertices.size(),
+																 indexData, indexCount);
+			this->positionDecode = quantizedData->decode;
+		} else {
+
+			this->geometry = GeometryArena::shared().allocate(vertexData, vertexCount, indexData, indexCount);
+		}
+	}
+
+	void Mesh::keepPositions(const Vertex* vertexData, size_t vertexCount) {
+
+		this->positions.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+
+			this->positions[i] = vertexData[i].Position;
+		}
 	}
 }
@@ -12,8 +12,13 @@
 #include <glm/glm.hpp>
 
 #include "Shader.hpp"
+#include "GeometryArena.hpp"
+#include "VertexQuantization.hpp"
+#include "Meshlets.hpp"
+#include "Bounds.hpp"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 
@@ -41,31 +46,163 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // Texture referenced by a material, before it is loaded
+    struct TextureRef {
+
+        //ambientTexture, diffuseTexture, specularTexture
+        std::string type;
+        //file name relative to the model's base path
+        std::string name;
+    };
+
+    // One level of detail: a range of the mesh's indices over the same vertices
+    struct MeshLod {
+
+        //offset into the mesh's indices, the full mesh is level 0 at offset 0
+        GLuint firstIndex;
+        GLuint indexCount;
+        //how far the surface may be from the full mesh, in model units
+        float error;
+    };
+
+    // What picking a level of detail needs to know about the view
+    struct LodSelection {
+
+        glm::vec3 cameraPosition;
+        //viewport height / (2 tan(fovy / 2)): pixels covered by one unit at distance 1
+        float projectionScale;
+        //largest error allowed on screen, in pixels
+        float maxPixelError;
+    };
+
+    // CPU-side geometry and material of one mesh, as produced by the .obj reader
+    struct MeshData {
+
+        //name of the object/group in the .obj file
+        std::string name;
+        std::vector<Vertex> vertices;
+        //the full mesh, followed by the coarser levels of `lods`
+        std::vector<GLuint> indices;
+        //empty when the mesh has a single level, all of `indices`
+        std::vector<MeshLod> lods;
+        //clusters of level 0, empty unless the load builds them
+        std::vector<Meshlet> meshlets;
+        //of the vertices, in model space
+        Bounds bounds;
+        Material material;
+        std::vector<TextureRef> textures;
+    };
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
         GLuint EBO;
     };
 
+    // What a mesh keeps in RAM once its geometry is in video memory
+    enum MeshResidency {
+        MESH_GPU_ONLY,          //nothing
+        MESH_KEEP_CPU_COPY,     //vertices and indices, e.g. for picking or physics
+        MESH_KEEP_POSITIONS     //positions and indices only, a ~3x smaller copy for ray casts and collision
+    };
+
     class Mesh {
 
     public:
+        std::string name;
+        // CPU copies of the geometry, filled according to the residency the mesh was built with
         std::vector<Vertex> vertices;
+        std::vector<glm::vec3> positions;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
 
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
-
-	    Buffers getBuffers();
-
-	    void Draw(gps::Shader shader);
+	    // Takes over the arrays; pass them with std::move to avoid copying the geometry.
+	    // With `quantized`, the encoded vertices go to video memory instead of these;
+	    // the CPU copies stay full floats. `lods` describes the levels of detail
+	    // appended to the indices (see MeshData); the CPU copy keeps level 0 only.
+	    // The bounds are computed from the vertices unless given.
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	         MeshResidency residency = MESH_KEEP_CPU_COPY, const QuantizedMesh* quantized = NULL,
+	         std::vector<MeshLod> lods = std::vector<MeshLod>(), const Bounds* bounds = NULL);
+
+	    // Uploads the geometry straight from the given arrays, copying only what `residency` keeps
+	    Mesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Texture> textures,
+	         MeshResidency residency = MESH_GPU_ONLY, const QuantizedMesh* quantized = NULL,
+	         std::vector<MeshLod> lods = std::vector<MeshLod>(), const Bounds* bounds = NULL);
+
+	    // A mesh owns its range of the shared GeometryArena, so it can be moved but
+	    // not copied. The range is given back with the mesh.
+	    Mesh(Mesh&& other) = default;
+	    Mesh& operator=(Mesh&& other) = default;
+	    Mesh(const Mesh&) = delete;
+	    Mesh& operator=(const Mesh&) = delete;
+
+	    // The arena's buffers, shared with every other mesh
+	    Buffers getBuffers() const;
+	    const GeometryRange& getGeometry() const;
+
+	    // Maps the positions in video memory to model space, applied after the
+	    // model matrix; NULL for float vertices, which need nothing
+	    const glm::mat4* getPositionDecode() const;
+
+	    // Box and sphere around the vertices, in model space; TransformBounds()
+	    // takes them to world space
+	    const Bounds& getBounds() const;
+
+	    // Bytes held by the CPU copies of the geometry
+	    size_t cpuBytes() const;
+
+	    void Draw(const gps::Shader& shader);
+	    void Draw(const gps::Shader& shader, size_t lod);
+	    // Draws only the given ranges of the mesh's indices, in one glMultiDrawElementsBaseVertex
+	    void DrawRanges(const gps::Shader& shader, const IndexRange* ranges, size_t count);
+
+	    // Levels of detail, at least one; level 0 is the full mesh
+	    size_t getLodCount() const;
+	    const MeshLod& getLod(size_t lod) const;
+
+	    // The coarsest level whose error, projected at the mesh's bounding sphere
+	    // nearest the camera, stays within selection.maxPixelError
+	    size_t selectLod(const glm::mat4& model, const LodSelection& selection) const;
+
+	    // Clusters of level 0 for culling inside the mesh, empty when none were built
+	    void setMeshlets(std::vector<Meshlet> meshlets);
+	    const std::vector<Meshlet>& getMeshlets() const;
+
+	    // Draws instanceCount copies reading the model matrices last uploaded to
+	    // InstanceBuffer::shared(), with a shader built from shaders/instanced.vert
+	    void DrawInstanced(const gps::Shader& shader, GLsizei instanceCount);
+
+	    // Unit and texture for every sampler unit of the shader's program: the
+	    // mesh's texture of that type, or 0 where it has none, so no unit keeps
+	    // the texture of the mesh drawn before. Looked up again only when the
+	    // program changes.
+	    const std::vector<std::pair<GLint, GLuint> >& getTextureBindings(const gps::Shader& shader);
 
     private:
         /*  Render data  */
-        Buffers buffers;
-
-	    // Initializes all the buffer objects/arrays
-	    void setupMesh();
+        GeometryRange geometry;
+        bool quantized;
+        glm::mat4 positionDecode;
+        std::vector<MeshLod> lods;
+        std::vector<Meshlet> meshlets;
+        Bounds bounds;
+
+        // getTextureBindings() of the program drawn last
+        GLuint unitsProgram;
+        std::vector<std::pair<GLint, GLuint> > textureBindings;
+        //DrawRanges() arguments, kept to avoid allocating every frame
+        std::vector<GLsizei> rangeCounts;
+        std::vector<const GLvoid*> rangeOffsets;
+        std::vector<GLint> rangeBaseVertices;
+
+	    // Copies the geometry into the shared arena
+	    void setupMesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+	                   const QuantizedMesh* quantizedData, std::vector<MeshLod> lodLevels, const Bounds* knownBounds);
+
+	    void keepPositions(const Vertex* vertexData, size_t vertexCount);
+
+	    void bindTextures(const gps::Shader& shader);
 
     };
 
@@ -0,0 +1,468 @@
+#include "MeshCache.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    namespace {
+
+        const char MESH_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'M', 'E', 'S', 'H', '\0' };
+        // Bump whenever the layout or the meaning of the baked data changes
+        const uint32_t MESH_CACHE_VERSION = 6;
+
+        const size_t BLOB_ALIGNMENT = 16;
+        // Bytes hashed at each end of a source file
+        const size_t HASH_SAMPLE_BYTES = 64 * 1024;
+
+        struct CacheHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t vertexSize;
+            uint32_t sourceCount;
+            uint32_t meshCount;
+            uint32_t textureCount;
+            uint32_t stringTableSize;
+            uint32_t bakeFlags;
+            uint32_t lodCount;
+            uint32_t meshletCount;
+            uint32_t padding;
+            uint64_t fileSize;
+        };
+
+        struct SourceRecord {
+            uint64_t size;
+            int64_t modified;
+            uint64_t hash;
+            uint32_t pathOffset;
+            uint32_t pathLength;
+        };
+
+        struct MeshRecord {
+            uint64_t vertexOffset;
+            uint64_t vertexCount;
+            uint64_t indexOffset;
+            uint64_t indexCount;
+            float ambient[3];
+            float diffuse[3];
+            float specular[3];
+            uint32_t firstTexture;
+            uint32_t textureCount;
+            uint32_t nameOffset;
+            uint32_t nameLength;
+            uint32_t firstLod;
+            uint32_t lodCount;
+            float boxMin[3];
+            float boxMax[3];
+            float sphereCenter[3];
+            float sphereRadius;
+            uint32_t firstMeshlet;
+            uint32_t meshletCount;
+            uint32_t padding;
+        };
+
+        struct TextureRecord {
+            uint32_t typeOffset;
+            uint32_t typeLength;
+            uint32_t nameOffset;
+            uint32_t nameLength;
+        };
+
+        struct LodRecord {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            float error;
+            uint32_t padding;
+        };
+
+        struct MeshletRecord {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            float center[3];
+            float radius;
+            float coneApex[3];
+            float coneAxis[3];
+            float coneCutoff;
+        };
+
+        static_assert(sizeof(CacheHeader) == 56, "unexpected CacheHeader padding");
+        static_assert(sizeof(SourceRecord) == 32, "unexpected SourceRecord padding");
+        static_assert(sizeof(MeshRecord) == 144, "unexpected MeshRecord padding");
+        static_assert(sizeof(TextureRecord) == 16, "unexpected TextureRecord padding");
+        static_assert(sizeof(LodRecord) == 16, "unexpected LodRecord padding");
+        static_assert(sizeof(MeshletRecord) == 52, "unexpected MeshletRecord padding");
+
+        inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        inline uint64_t fnv1a(const char* data, size_t size, uint64_t hash) {
+            for (size_t i = 0; i < size; i++) {
+                hash ^= (unsigned char)data[i];
+                hash *= 0x100000001B3ULL;
+            }
+            return hash;
+        }
+
+        // Size, modification time and a hash of the first and last bytes of a
+        // file; hashing only samples keeps validation cheap for huge sources
+        bool fingerprint(const std::string& path, SourceRecord* record) {
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0) {
+                return false;
+            }
+
+            MappedFile source;
+            if (!source.open(path)) {
+                return false;
+            }
+
+            uint64_t hash = 0xCBF29CE484222325ULL;
+            size_t head = std::min(source.size(), HASH_SAMPLE_BYTES);
+            size_t tailStart = std::max(head, source.size() - std::min(source.size(), HASH_SAMPLE_BYTES));
+            hash = fnv1a(source.data(), head, hash);
+            hash = fnv1a(source.data() + tailStart, source.size() - tailStart, hash);
+
+            record->size = (uint64_t)source.size();
+            record->modified = (int64_t)info.st_mtime;
+            record->hash = hash;
+            return true;
+        }
+
+        struct StringTable {
+            std::string bytes;
+
+            uint32_t add(const std::string& value) {
+                uint32_t offset = (uint32_t)bytes.size();
+                bytes += value;
+                return offset;
+            }
+        };
+
+        inline void writeZeros(std::ofstream& out, uint64_t count) {
+            static const char zeros[BLOB_ALIGNMENT] = { 0 };
+            out.write(zeros, (std::streamsize)count);
+        }
+    }
+
+    std::string MeshCache::cacheFileName(const std::string& objFileName) {
+        return objFileName + ".meshcache";
+    }
+
+    bool MeshCache::write(const std::string& objFileName, const std::string& basePath,
+                          const std::vector<std::string>& materialLibraries,
+                          const std::vector<MeshData>& meshes, uint32_t bakeFlags) {
+
+        StringTable strings;
+
+        std::vector<std::string> sourcePaths;
+        sourcePaths.push_back(objFileName);
+        for (size_t i = 0; i < materialLibraries.size(); i++) {
+            sourcePaths.push_back(basePath + materialLibraries[i]);
+        }
+
+        std::vector<SourceRecord> sources(sourcePaths.size());
+        for (size_t i = 0; i < sourcePaths.size(); i++) {
+            if (!fingerprint(sourcePaths[i], &sources[i])) {
+                //a missing .mtl is tolerated by the loader, but then there is nothing to key on
+                return false;
+            }
+            sources[i].pathLength = (uint32_t)sourcePaths[i].size();
+            sources[i].pathOffset = strings.add(sourcePaths[i]);
+        }
+
+        std::vector<MeshRecord> records(meshes.size());
+        std::vector<TextureRecord> textures;
+        std::vector<LodRecord> lods;
+        std::vector<MeshletRecord> meshlets;
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const MeshData& mesh = meshes[m];
+            MeshRecord& record = records[m];
+            memset(&record, 0, sizeof(record));
+
+            record.vertexCount = mesh.vertices.size();
+            record.indexCount = mesh.indices.size();
+            record.nameLength = (uint32_t)mesh.name.size();
+            record.nameOffset = strings.add(mesh.name);
+            for (int c = 0; c < 3; c++) {
+                record.ambient[c] = mesh.material.ambient[c];
+                record.diffuse[c] = mesh.material.diffuse[c];
+                record.specular[c] = mesh.material.specular[c];
+                record.boxMin[c] = mesh.bounds.box.min[c];
+                record.boxMax[c] = mesh.bounds.box.max[c];
+                record.sphereCenter[c] = mesh.bounds.sphere.center[c];
+            }
+            record.sphereRadius = mesh.bounds.sphere.radius;
+
+            record.firstTexture = (uint32_t)textures.size();
+            record.textureCount = (uint32_t)mesh.textures.size();
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                TextureRecord texture;
+                texture.typeLength = (uint32_t)mesh.textures[t].type.size();
+                texture.typeOffset = strings.add(mesh.textures[t].type);
+                texture.nameLength = (uint32_t)mesh.textures[t].name.size();
+                texture.nameOffset = strings.add(mesh.textures[t].name);
+                textures.push_back(texture);
+            }
+
+            record.firstLod = (uint32_t)lods.size();
+            record.lodCount = (uint32_t)mesh.lods.size();
+            for (size_t l = 0; l < mesh.lods.size(); l++) {
+                LodRecord lod;
+                lod.firstIndex = mesh.lods[l].firstIndex;
+                lod.indexCount = mesh.lods[l].indexCount;
+                lod.error = mesh.lods[l].error;
+                lod.padding = 0;
+                lods.push_back(lod);
+            }
+
+            record.firstMeshlet = (uint32_t)meshlets.size();
+            record.meshletCount = (uint32_t)mesh.meshlets.size();
+            for (size_t i = 0; i < mesh.meshlets.size(); i++) {
+                const Meshlet& source = mesh.meshlets[i];
+                MeshletRecord meshlet;
+                meshlet.firstIndex = source.firstIndex;
+                meshlet.indexCount = source.indexCount;
+                for (int c = 0; c < 3; c++) {
+                    meshlet.center[c] = source.center[c];
+                    meshlet.coneApex[c] = source.coneApex[c];
+                    meshlet.coneAxis[c] = source.coneAxis[c];
+                }
+                meshlet.radius = source.radius;
+                meshlet.coneCutoff = source.coneCutoff;
+                meshlets.push_back(meshlet);
+            }
+        }
+
+        CacheHeader header;
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = (uint32_t)sizeof(Vertex);
+        header.sourceCount = (uint32_t)sources.size();
+        header.meshCount = (uint32_t)records.size();
+        header.textureCount = (uint32_t)textures.size();
+        header.stringTableSize = (uint32_t)strings.bytes.size();
+        header.bakeFlags = bakeFlags;
+        header.lodCount = (uint32_t)lods.size();
+        header.meshletCount = (uint32_t)meshlets.size();
+        header.padding = 0;
+
+        // Lay out the blobs after the tables
+        uint64_t offset = sizeof(CacheHeader)
+            + sources.size() * sizeof(SourceRecord)
+            + records.size() * sizeof(MeshRecord)
+            + textures.size() * sizeof(TextureRecord)
+            + lods.size() * sizeof(LodRecord)
+            + meshlets.size() * sizeof(MeshletRecord)
+            + strings.bytes.size();
+        const uint64_t tablesEnd = offset;
+
+        for (size_t m = 0; m < records.size(); m++) {
+            offset = alignUp(offset, BLOB_ALIGNMENT);
+            records[m].vertexOffset = offset;
+            offset += records[m].vertexCount * sizeof(Vertex);
+
+            offset = alignUp(offset, BLOB_ALIGNMENT);
+            records[m].indexOffset = offset;
+            offset += records[m].indexCount * sizeof(GLuint);
+        }
+        header.fileSize = offset;
+
+        // Write next to the final name and rename, so a reader never maps a half-written cache
+        std::string cacheName = cacheFileName(objFileName);
+        std::string temporaryName = cacheName + ".tmp";
+
+        std::ofstream out(temporaryName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)sources.data(), (std::streamsize)(sources.size() * sizeof(SourceRecord)));
+        out.write((const char*)records.data(), (std::streamsize)(records.size() * sizeof(MeshRecord)));
+        out.write((const char*)textures.data(), (std::streamsize)(textures.size() * sizeof(TextureRecord)));
+        out.write((const char*)lods.data(), (std::streamsize)(lods.size() * sizeof(LodRecord)));
+        out.write((const char*)meshlets.data(), (std::streamsize)(meshlets.size() * sizeof(MeshletRecord)));
+        out.write(strings.bytes.data(), (std::streamsize)strings.bytes.size());
+
+        uint64_t written = tablesEnd;
+        for (size_t m = 0; m < records.size(); m++) {
+            writeZeros(out, records[m].vertexOffset - written);
+            out.write((const char*)meshes[m].vertices.data(), (std::streamsize)(records[m].vertexCount * sizeof(Vertex)));
+            written = records[m].vertexOffset + records[m].vertexCount * sizeof(Vertex);
+
+            writeZeros(out, records[m].indexOffset - written);
+            out.write((const char*)meshes[m].indices.data(), (std::streamsize)(records[m].indexCount * sizeof(GLuint)));
+            written = records[m].indexOffset + records[m].indexCount * sizeof(GLuint);
+        }
+
+        out.close();
+        if (!out) {
+            std::remove(temporaryName.c_str());
+            return false;
+        }
+
+        std::remove(cacheName.c_str());
+        return std::rename(temporaryName.c_str(), cacheName.c_str()) == 0;
+    }
+
+    bool MeshCache::open(const std::string& objFileName, uint32_t bakeFlags) {
+        views.clear();
+
+        if (!file.open(cacheFileName(objFileName))) {
+            return false;
+        }
+
+        const char* base = file.data();
+        const uint64_t size = file.size();
+
+        if (size < sizeof(CacheHeader)) {
+            file.close();
+            return false;
+        }
+
+        CacheHeader header;
+        memcpy(&header, base, sizeof(header));
+
+        if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MESH_CACHE_VERSION ||
+            header.vertexSize != sizeof(Vertex) ||
+            header.bakeFlags != bakeFlags ||
+            header.fileSize != size ||
+            header.sourceCount == 0) {
+            file.close();
+            return false;
+        }
+
+        const uint64_t tablesEnd = sizeof(CacheHeader)
+            + (uint64_t)header.sourceCount * sizeof(SourceRecord)
+            + (uint64_t)header.meshCount * sizeof(MeshRecord)
+            + (uint64_t)header.textureCount * sizeof(TextureRecord)
+            + (uint64_t)header.lodCount * sizeof(LodRecord)
+            + (uint64_t)header.meshletCount * sizeof(MeshletRecord)
+            + header.stringTableSize;
+
+        if (tablesEnd > size) {
+            file.close();
+            return false;
+        }
+
+        const SourceRecord* sources = (const SourceRecord*)(base + sizeof(CacheHeader));
+        const MeshRecord* records = (const MeshRecord*)(sources + header.sourceCount);
+        const TextureRecord* textures = (const TextureRecord*)(records + header.meshCount);
+        const LodRecord* lods = (const LodRecord*)(textures + header.textureCount);
+        const MeshletRecord* meshlets = (const MeshletRecord*)(lods + header.lodCount);
+        const char* strings = (const char*)(meshlets + header.meshletCount);
+
+        // Any change to the .obj or one of its .mtl files invalidates the cache
+        for (uint32_t i = 0; i < header.sourceCount; i++) {
+            const SourceRecord& source = sources[i];
+            if ((uint64_t)source.pathOffset + source.pathLength > header.stringTableSize) {
+                file.close();
+                return false;
+            }
+
+            std::string path(strings + source.pathOffset, source.pathLength);
+            SourceRecord current;
+            if (!fingerprint(path, &current) ||
+                current.size != source.size ||
+                current.modified != source.modified ||
+                current.hash != source.hash) {
+                file.close();
+                return false;
+            }
+        }
+
+        for (uint32_t m = 0; m < header.meshCount; m++) {
+            const MeshRecord& record = records[m];
+
+            if (record.vertexOffset % BLOB_ALIGNMENT != 0 || record.indexOffset % BLOB_ALIGNMENT != 0 ||
+                record.vertexOffset + record.vertexCount * sizeof(Vertex) > size ||
+                record.indexOffset + record.indexCount * sizeof(GLuint) > size ||
+                (uint64_t)record.firstTexture + record.textureCount > header.textureCount ||
+                (uint64_t)record.firstLod + record.lodCount > header.lodCount ||
+                (uint64_t)record.firstMeshlet + record.meshletCount > header.meshletCount ||
+                (uint64_t)record.nameOffset + record.nameLength > header.stringTableSize) {
+                views.clear();
+                file.close();
+                return false;
+            }
+
+            MeshView view;
+            view.name = std::string(strings + record.nameOffset, record.nameLength);
+            view.vertices = (const Vertex*)(base + record.vertexOffset);
+            view.vertexCount = (size_t)record.vertexCount;
+            view.indices = (const GLuint*)(base + record.indexOffset);
+            view.indexCount = (size_t)record.indexCount;
+            for (uint32_t l = 0; l < record.lodCount; l++) {
+                const LodRecord& lod = lods[record.firstLod + l];
+                if ((uint64_t)lod.firstIndex + lod.indexCount > record.indexCount) {
+                    views.clear();
+                    file.close();
+                    return false;
+                }
+
+                MeshLod level = { lod.firstIndex, lod.indexCount, lod.error };
+                view.lods.push_back(level);
+            }
+            for (uint32_t i = 0; i < record.meshletCount; i++) {
+                const MeshletRecord& meshlet = meshlets[record.firstMeshlet + i];
+                if ((uint64_t)meshlet.firstIndex + meshlet.indexCount > record.indexCount) {
+                    views.clear();
+                    file.close();
+                    return false;
+                }
+
+                Meshlet cluster;
+                cluster.firstIndex = meshlet.firstIndex;
+                cluster.indexCount = meshlet.indexCount;
+                cluster.center = glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+                cluster.radius = meshlet.radius;
+                cluster.coneApex = glm::vec3(meshlet.coneApex[0], meshlet.coneApex[1], meshlet.coneApex[2]);
+                cluster.coneAxis = glm::vec3(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+                cluster.coneCutoff = meshlet.coneCutoff;
+                view.meshlets.push_back(cluster);
+            }
+            view.material.ambient = glm::vec3(record.ambient[0], record.ambient[1], record.ambient[2]);
+            view.material.diffuse = glm::vec3(record.diffuse[0], record.diffuse[1], record.diffuse[2]);
+            view.material.specular = glm::vec3(record.specular[0], record.specular[1], record.specular[2]);
+            view.bounds.box.min = glm::vec3(record.boxMin[0], record.boxMin[1], record.boxMin[2]);
+            view.bounds.box.max = glm::vec3(record.boxMax[0], record.boxMax[1], record.boxMax[2]);
+            view.bounds.sphere.center = glm::vec3(record.sphereCenter[0], record.sphereCenter[1], record.sphereCenter[2]);
+            view.bounds.sphere.radius = record.sphereRadius;
+
+            for (uint32_t t = 0; t < record.textureCount; t++) {
+                const TextureRecord& texture = textures[record.firstTexture + t];
+                if ((uint64_t)texture.typeOffset + texture.typeLength > header.stringTableSize ||
+                    (uint64_t)texture.nameOffset + texture.nameLength > header.stringTableSize) {
+                    views.clear();
+                    file.close();
+                    return false;
+                }
+
+                TextureRef ref;
+                ref.type = std::string(strings + texture.typeOffset, texture.typeLength);
+                ref.name = std::string(strings + texture.nameOffset, texture.nameLength);
+                view.textures.push_back(ref);
+            }
+
+            views.push_back(view);
+        }
+
+        return true;
+    }
+
+    size_t MeshCache::meshCount() const {
+        return views.size();
+    }
+
+    MeshView MeshCache::mesh(size_t index) const {
+        return views[index];
+    }
+}
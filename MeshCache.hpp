@@ -0,0 +1,70 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Geometry of one cached mesh; the arrays point into the mapped cache file
+    struct MeshView {
+
+        std::string name;
+        const Vertex* vertices;
+        size_t vertexCount;
+        //every level of detail, as in MeshData
+        const GLuint* indices;
+        size_t indexCount;
+        std::vector<MeshLod> lods;
+        std::vector<Meshlet> meshlets;
+        Bounds bounds;
+        Material material;
+        std::vector<TextureRef> textures;
+    };
+
+    // Load options that change the baked data; a cache is only used by loads
+    // with the same flags it was baked with
+    enum MeshBakeFlags {
+        BAKE_FLIPPED_TEXCOORDS = 1 << 0,
+        BAKE_OPTIMIZED_MESHES = 1 << 1,
+        BAKE_LOD_CHAINS = 1 << 2,
+        BAKE_MESHLETS = 1 << 3
+    };
+
+    // Binary cache of the meshes baked from an .obj file, stored next to it as
+    // <file>.obj.meshcache. The cache is keyed on the size, modification time and
+    // a sampled content hash of the .obj and of every .mtl it references, and is
+    // ignored as soon as any of them changes or the format version is bumped.
+    //
+    // Layout: header, source records, mesh records, texture records, LOD
+    // records, meshlet records, string table, then the 16-byte aligned vertex
+    // and index blobs of every mesh.
+    class MeshCache {
+
+    public:
+        static std::string cacheFileName(const std::string& objFileName);
+
+        // Writes the cache for meshes read from objFileName; materialLibraries are
+        // the .mtl files (relative to basePath) the meshes' materials come from
+        static bool write(const std::string& objFileName, const std::string& basePath,
+                          const std::vector<std::string>& materialLibraries,
+                          const std::vector<MeshData>& meshes, uint32_t bakeFlags);
+
+        // Maps the cache of objFileName; returns false if there is none, it is
+        // stale or it was baked with other MeshBakeFlags
+        bool open(const std::string& objFileName, uint32_t bakeFlags);
+
+        size_t meshCount() const;
+        MeshView mesh(size_t index) const;
+
+    private:
+        MappedFile file;
+        std::vector<MeshView> views;
+    };
+}
+
+#endif /* MeshCache_hpp */
@@ -0,0 +1,450 @@
+#include "MeshOptimizer.hpp"
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace gps {
+
+    namespace {
+
+        // Cache Forsyth's scores assume, larger than the FIFO the analyzer simulates
+        const int FORSYTH_CACHE_SIZE = 32;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        // Side of the square the overdraw analyzer rasterizes into
+        const int OVERDRAW_RESOLUTION = 256;
+
+        // Forsyth's vertex score: recently used vertices and vertices with few
+        // triangles left score high, so triangles using them are emitted soon
+        float VertexScore(int cachePosition, unsigned remaining) {
+            if (remaining == 0) {
+                return -1.0f;
+            }
+
+            float score = 0.0f;
+            if (cachePosition >= 0) {
+                if (cachePosition < 3) {
+                    //the last triangle's vertices, kept from scoring too high so it does not repeat
+                    score = LAST_TRIANGLE_SCORE;
+                } else {
+                    float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+                }
+            }
+            return score + VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+        }
+
+        // FIFO cache simulated with timestamps: a vertex is cached while fewer than
+        // cacheSize misses happened since its own
+        class FifoCache {
+
+        public:
+            FifoCache(size_t vertexCount, size_t cacheSize)
+                : stamps(vertexCount, 0), size(cacheSize), time(cacheSize + 1) {
+            }
+
+            // True on a miss, which loads the vertex
+            bool access(GLuint vertex) {
+                if (time - stamps[vertex] <= size) {
+                    return false;
+                }
+                stamps[vertex] = time++;
+                return true;
+            }
+
+            // Forgets everything, as if a long unrelated stretch had been drawn
+            void flush() {
+                time += size + 1;
+            }
+
+        private:
+            std::vector<size_t> stamps;
+            size_t size;
+            size_t time;
+        };
+
+        size_t CountMisses(FifoCache& cache, const GLuint* triangle) {
+            size_t misses = 0;
+            for (int c = 0; c < 3; c++) {
+                if (cache.access(triangle[c])) {
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        glm::vec3 TriangleCross(const Vertex* vertices, const GLuint* triangle) {
+            glm::vec3 a = vertices[triangle[0]].Position;
+            return glm::cross(vertices[triangle[1]].Position - a, vertices[triangle[2]].Position - a);
+        }
+    }
+
+    VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, size_t cacheSize) {
+        VertexCacheStats stats = { 0.0f, 0.0f };
+        if (indexCount < 3) {
+            return stats;
+        }
+
+        FifoCache cache(vertexCount, cacheSize);
+        std::vector<bool> used(vertexCount, false);
+        size_t misses = 0;
+        size_t usedVertices = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            if (cache.access(indices[i])) {
+                misses++;
+            }
+            if (!used[indices[i]]) {
+                used[indices[i]] = true;
+                usedVertices++;
+            }
+        }
+
+        stats.acmr = (float)misses / (float)(indexCount / 3);
+        stats.atvr = (float)misses / (float)usedVertices;
+        return stats;
+    }
+
+    OverdrawStats AnalyzeOverdraw(const GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount) {
+        OverdrawStats stats = { 0.0f, 0, 0 };
+        if (indexCount < 3 || vertexCount == 0) {
+            return stats;
+        }
+
+        BoundingBox box = ComputeBox(vertices, vertexCount);
+        const glm::vec3& boundsMin = box.min;
+        glm::vec3 extent = box.max - box.min;
+        float largestSide = std::max(extent.x, std::max(extent.y, extent.z));
+        if (largestSide <= 0.0f) {
+            return stats;
+        }
+        //same scale on every axis, so no view stretches the mesh
+        float scale = (OVERDRAW_RESOLUTION - 1) / largestSide;
+
+        const float FAR_DEPTH = std::numeric_limits<float>::max();
+        std::vector<float> depth(OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION);
+
+        for (int axis = 0; axis < 3; axis++) {
+            int u = (axis + 1) % 3;
+            int v = (axis + 2) % 3;
+
+            //looking down -axis, then down +axis, which mirrors u so front faces stay counter-clockwise
+            for (int side = 0; side < 2; side++) {
+                std::fill(depth.begin(), depth.end(), FAR_DEPTH);
+
+                for (size_t t = 0; t + 2 < indexCount; t += 3) {
+                    float x[3], y[3], z[3];
+                    for (int c = 0; c < 3; c++) {
+                        const glm::vec3& p = vertices[indices[t + c]].Position;
+                        x[c] = (p[u] - boundsMin[u]) * scale;
+                        y[c] = (p[v] - boundsMin[v]) * scale;
+                        z[c] = side == 0 ? -p[axis] : p[axis];
+                        if (side == 1) {
+                            x[c] = (OVERDRAW_RESOLUTION - 1) - x[c];
+                        }
+                    }
+
+                    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+                    if (area <= 0.0f) {
+                        //back facing or degenerate, culled
+                        continue;
+                    }
+
+                    int minX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+                    int maxX = std::min(OVERDRAW_RESOLUTION - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+                    int minY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+                    int maxY = std::min(OVERDRAW_RESOLUTION - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+
+                    for (int py = minY; py <= maxY; py++) {
+                        for (int px = minX; px <= maxX; px++) {
+                            float sx = px + 0.5f;
+                            float sy = py + 0.5f;
+                            float w0 = (x[2] - x[1]) * (sy - y[1]) - (y[2] - y[1]) * (sx - x[1]);
+                            float w1 = (x[0] - x[2]) * (sy - y[2]) - (y[0] - y[2]) * (sx - x[2]);
+                            float w2 = (x[1] - x[0]) * (sy - y[0]) - (y[1] - y[0]) * (sx - x[0]);
+                            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                                continue;
+                            }
+
+                            //early depth test in submission order, as the GPU does
+                            float fragmentDepth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+                            float& stored = depth[py * OVERDRAW_RESOLUTION + px];
+                            if (fragmentDepth < stored) {
+                                stored = fragmentDepth;
+                                stats.pixelsShaded++;
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < depth.size(); i++) {
+                    if (depth[i] != FAR_DEPTH) {
+                        stats.pixelsCovered++;
+                    }
+                }
+            }
+        }
+
+        stats.overdraw = stats.pixelsCovered > 0 ? (float)stats.pixelsShaded / (float)stats.pixelsCovered : 0.0f;
+        return stats;
+    }
+
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        //triangles of every vertex; the first remaining[v] of them are not emitted yet
+        std::vector<unsigned> remaining(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            remaining[indices[i]]++;
+        }
+        std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+        }
+        std::vector<unsigned> adjacency(triangleCount * 3);
+        std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = (unsigned)(i / 3);
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScore[v] = VertexScore(-1, remaining[v]);
+        }
+        std::vector<float> triangleScore(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        }
+        std::vector<bool> emitted(triangleCount, false);
+
+        std::vector<GLuint> output;
+        output.reserve(triangleCount * 3);
+        std::vector<GLuint> cache;
+        std::vector<GLuint> newCache;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+        size_t best = (size_t)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+        //next triangle to look at when the cache offers no candidate
+        size_t scanCursor = 0;
+
+        while (best < triangleCount) {
+            emitted[best] = true;
+            const GLuint* triangle = &indices[best * 3];
+            output.insert(output.end(), triangle, triangle + 3);
+
+            for (int c = 0; c < 3; c++) {
+                GLuint v = triangle[c];
+                unsigned* begin = &adjacency[firstTriangle[v]];
+                unsigned* last = begin + remaining[v] - 1;
+                std::iter_swap(std::find(begin, last + 1, (unsigned)best), last);
+                remaining[v]--;
+            }
+
+            //the triangle's vertices move to the front, the rest shift back
+            newCache.assign(triangle, triangle + 3);
+            for (size_t i = 0; i < cache.size(); i++) {
+                if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+                    newCache.push_back(cache[i]);
+                }
+            }
+            for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); i++) {
+                cachePosition[newCache[i]] = -1;
+            }
+
+            //rescore every vertex whose position changed, and its triangles with it
+            for (size_t i = 0; i < newCache.size(); i++) {
+                GLuint v = newCache[i];
+                if (i < (size_t)FORSYTH_CACHE_SIZE) {
+                    cachePosition[v] = (int)i;
+                }
+                float score = VertexScore(cachePosition[v], remaining[v]);
+                float delta = score - vertexScore[v];
+                vertexScore[v] = score;
+                for (size_t a = firstTriangle[v]; a < firstTriangle[v] + remaining[v]; a++) {
+                    triangleScore[adjacency[a]] += delta;
+                }
+            }
+            if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+                newCache.resize(FORSYTH_CACHE_SIZE);
+            }
+            cache.swap(newCache);
+
+            //best triangle touching the cache
+            best = triangleCount;
+            float bestScore = -std::numeric_limits<float>::max();
+            for (size_t i = 0; i < cache.size(); i++) {
+                GLuint v = cache[i];
+                for (size_t a = firstTriangle[v]; a < firstTriangle[v] + remaining[v]; a++) {
+                    if (triangleScore[adjacency[a]] > bestScore) {
+                        bestScore = triangleScore[adjacency[a]];
+                        best = adjacency[a];
+                    }
+                }
+            }
+
+            if (best == triangleCount) {
+                //nothing left around the cache, start over anywhere
+                while (scanCursor < triangleCount && emitted[scanCursor]) {
+                    scanCursor++;
+                }
+                best = scanCursor;
+            }
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    void OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+        VertexCacheStats before = AnalyzeVertexCache(indices, triangleCount * 3, vertexCount);
+
+        //hard boundaries: triangles missing on all three vertices, where the cache is cold anyway
+        std::vector<size_t> hardClusters;
+        FifoCache cache(vertexCount, VERTEX_CACHE_SIZE);
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (CountMisses(cache, &indices[t * 3]) == 3 || t == 0) {
+                hardClusters.push_back(t);
+            }
+        }
+        hardClusters.push_back(triangleCount);
+
+        //soft boundaries inside each: wherever the part before, drawn from a cold
+        //cache, costs at most threshold times the whole cluster's ACMR
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hardClusters.size(); h++) {
+            size_t first = hardClusters[h];
+            size_t end = hardClusters[h + 1];
+
+            cache.flush();
+            size_t hardMisses = 0;
+            for (size_t t = first; t < end; t++) {
+                hardMisses += CountMisses(cache, &indices[t * 3]);
+            }
+            float clusterThreshold = threshold * (float)hardMisses / (float)(end - first);
+
+            cache.flush();
+            size_t clusterStart = first;
+            size_t clusterMisses = 0;
+            clusters.push_back(first);
+            for (size_t t = first; t + 1 < end; t++) {
+                clusterMisses += CountMisses(cache, &indices[t * 3]);
+                if ((float)clusterMisses <= clusterThreshold * (float)(t + 1 - clusterStart)) {
+                    clusters.push_back(t + 1);
+                    clusterStart = t + 1;
+                    clusterMisses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+        size_t clusterCount = clusters.size() - 1;
+        if (clusterCount < 2) {
+            return;
+        }
+
+        //area weighted centroid of the mesh
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const GLuint* triangle = &indices[t * 3];
+            float area = glm::length(TriangleCross(vertices, triangle));
+            meshCentroid += (vertices[triangle[0]].Position + vertices[triangle[1]].Position + vertices[triangle[2]].Position) * (area / 3.0f);
+            meshArea += area;
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+
+        //clusters facing away from the centre draw first and hide the rest
+        std::vector<std::pair<float, size_t> > order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                const GLuint* triangle = &indices[t * 3];
+                glm::vec3 cross = TriangleCross(vertices, triangle);
+                float triangleArea = glm::length(cross);
+                centroid += (vertices[triangle[0]].Position + vertices[triangle[1]].Position + vertices[triangle[2]].Position) * (triangleArea / 3.0f);
+                normal += cross;
+                area += triangleArea;
+            }
+            float key = 0.0f;
+            float normalLength = glm::length(normal);
+            if (area > 0.0f && normalLength > 0.0f) {
+                key = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+            }
+            order[c] = std::make_pair(-key, c);
+        }
+        std::stable_sort(order.begin(), order.end());
+
+        std::vector<GLuint> reordered;
+        reordered.reserve(triangleCount * 3);
+        for (size_t i = 0; i < clusterCount; i++) {
+            size_t c = order[i].second;
+            reordered.insert(reordered.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+        }
+
+        VertexCacheStats after = AnalyzeVertexCache(reordered.data(), reordered.size(), vertexCount);
+        if (after.acmr <= threshold * before.acmr) {
+            std::copy(reordered.begin(), reordered.end(), indices);
+        }
+    }
+
+    void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+        const GLuint UNUSED = std::numeric_limits<GLuint>::max();
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& index = indices[i];
+            if (remap[index] == UNUSED) {
+                remap[index] = (GLuint)reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+    MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        MeshOptimizationReport report;
+        report.cacheBefore = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        report.overdrawBefore = AnalyzeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+
+        OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+        //up to 5% more vertex shading for less overdraw
+        OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size(), 1.05f);
+        OptimizeVertexFetch(vertices, indices);
+
+        report.cacheAfter = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        report.overdrawAfter = AnalyzeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    void ReportMeshOptimization(const std::string& meshName, const MeshOptimizationReport& report) {
+        std::cout << "Optimized      : " << (meshName.empty() ? "(unnamed)" : meshName)
+                  << " ACMR " << report.cacheBefore.acmr << " -> " << report.cacheAfter.acmr
+                  << ", ATVR " << report.cacheBefore.atvr << " -> " << report.cacheAfter.atvr
+                  << ", overdraw " << report.overdrawBefore.overdraw << " -> " << report.overdrawAfter.overdraw
+                  << " in " << report.seconds * 1000.0 << " ms" << std::endl;
+    }
+}
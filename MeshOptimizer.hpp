@@ -0,0 +1,67 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Post-transform vertex cache behaviour of an index buffer, simulated as a FIFO
+    struct VertexCacheStats {
+        //vertex shader runs per triangle, 0.5 is the best a large grid can do, 3 the worst
+        float acmr;
+        //vertex shader runs per vertex, 1 is ideal
+        float atvr;
+    };
+
+    // Overdraw of a mesh rendered in its index order with early depth testing,
+    // averaged over six axis-aligned views
+    struct OverdrawStats {
+        //fragments shaded per covered pixel, 1 is ideal
+        float overdraw;
+        size_t pixelsCovered;
+        size_t pixelsShaded;
+    };
+
+    // FIFO size the analyzers simulate, about what current GPUs reuse
+    const size_t VERTEX_CACHE_SIZE = 16;
+
+    VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount,
+                                        size_t cacheSize = VERTEX_CACHE_SIZE);
+
+    // Rasterizes the triangles on the CPU, no GL context needed
+    OverdrawStats AnalyzeOverdraw(const GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount);
+
+    // Reorders the triangles for vertex reuse (Forsyth's linear-speed algorithm)
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    // Reorders clusters of an already cache-optimized index buffer so outward
+    // facing ones come first and occlude the rest (Sander et al., "Fast Triangle
+    // Reordering for Vertex Locality and Reduced Overdraw"). Clusters are cut
+    // where the cache is cold anyway, or where it costs at most `threshold`
+    // times the mesh's ACMR; the order is kept when the cache would lose more.
+    void OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold);
+
+    // Renumbers the vertices in the order the indices first use them, so vertex
+    // fetches walk memory forwards, and drops unreferenced vertices
+    void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    struct MeshOptimizationReport {
+        VertexCacheStats cacheBefore;
+        VertexCacheStats cacheAfter;
+        OverdrawStats overdrawBefore;
+        OverdrawStats overdrawAfter;
+        double seconds;
+    };
+
+    // The three passes above, in order, measured before and after
+    MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // One line per mesh, for the load log
+    void ReportMeshOptimization(const std::string& meshName, const MeshOptimizationReport& report);
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,509 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gps {
+
+    namespace {
+
+        // How far a collapse may turn a triangle: the cosine between its normals before and after
+        const float MIN_NORMAL_COSINE = 0.25f;
+        // Weight of the planes keeping open borders in place, against the area weighted triangle planes
+        const double BORDER_WEIGHT = 10.0;
+        // Passes over the candidate edges before giving up on the target
+        const int MAX_PASSES = 64;
+        // A level dropping less than this share of the previous level's triangles ends the chain
+        const float MIN_LOD_REDUCTION = 0.9f;
+        // No level below this many triangles
+        const size_t MIN_LOD_TRIANGLES = 16;
+
+        enum VertexKind {
+            VERTEX_MANIFOLD,    //inside a surface, collapses in any direction
+            VERTEX_BORDER,      //on an open border, collapses along it
+            VERTEX_SEAM,        //one of the two vertices on a UV or normal seam, collapses along it
+            VERTEX_LOCKED       //anything else: corners, seam ends, non-manifold fans
+        };
+
+        // Sum of squared distances to a set of weighted planes, as a symmetric matrix
+        struct Quadric {
+            double a00, a01, a02, a11, a12, a22;
+            double b0, b1, b2;
+            double c;
+            double weight;
+        };
+
+        void AddPlane(Quadric& q, const glm::vec3& normal, double distance, double weight) {
+            double x = normal.x, y = normal.y, z = normal.z;
+            q.a00 += weight * x * x;
+            q.a01 += weight * x * y;
+            q.a02 += weight * x * z;
+            q.a11 += weight * y * y;
+            q.a12 += weight * y * z;
+            q.a22 += weight * z * z;
+            q.b0 += weight * x * distance;
+            q.b1 += weight * y * distance;
+            q.b2 += weight * z * distance;
+            q.c += weight * distance * distance;
+            q.weight += weight;
+        }
+
+        void AddQuadric(Quadric& q, const Quadric& other) {
+            q.a00 += other.a00;
+            q.a01 += other.a01;
+            q.a02 += other.a02;
+            q.a11 += other.a11;
+            q.a12 += other.a12;
+            q.a22 += other.a22;
+            q.b0 += other.b0;
+            q.b1 += other.b1;
+            q.b2 += other.b2;
+            q.c += other.c;
+            q.weight += other.weight;
+        }
+
+        // Weighted sum of squared distances from p to the planes of both quadrics, per unit of weight
+        double CollapseError(const Quadric& q, const Quadric& other, const glm::vec3& p) {
+            double x = p.x, y = p.y, z = p.z;
+            double a00 = q.a00 + other.a00, a01 = q.a01 + other.a01, a02 = q.a02 + other.a02;
+            double a11 = q.a11 + other.a11, a12 = q.a12 + other.a12, a22 = q.a22 + other.a22;
+            double error = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * ((q.b0 + other.b0) * x + (q.b1 + other.b1) * y + (q.b2 + other.b2) * z)
+                + q.c + other.c;
+            double weight = q.weight + other.weight;
+            return std::fabs(error) / (weight > 0.0 ? weight : 1.0);
+        }
+
+        inline uint64_t EdgeKey(GLuint from, GLuint to) {
+            return ((uint64_t)from << 32) | to;
+        }
+
+        struct PositionHash {
+            size_t operator()(const glm::vec3& p) const {
+                //adding zero turns -0 into 0, which compares equal
+                float coordinates[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+                uint32_t bits[3];
+                memcpy(bits, coordinates, sizeof(bits));
+                return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+
+        struct PositionEqual {
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+                return a.x == b.x && a.y == b.y && a.z == b.z;
+            }
+        };
+
+        struct Collapse {
+            GLuint from;
+            GLuint to;
+            double error;
+
+            bool operator<(const Collapse& other) const {
+                return error < other.error;
+            }
+        };
+
+        // Topology of the current indices, rebuilt every pass
+        class Topology {
+
+        public:
+            Topology(const std::vector<GLuint>& position, size_t vertexCount)
+                : position(position), kind(vertexCount, VERTEX_LOCKED), twin(vertexCount) {
+            }
+
+            void build(const std::vector<GLuint>& indices) {
+                size_t vertexCount = kind.size();
+                indexEdges.clear();
+                positionEdges.clear();
+                for (size_t i = 0; i < indices.size(); i += 3) {
+                    for (int c = 0; c < 3; c++) {
+                        GLuint a = indices[i + c];
+                        GLuint b = indices[i + (c + 1) % 3];
+                        indexEdges.insert(EdgeKey(a, b));
+                        positionEdges.insert(EdgeKey(position[a], position[b]));
+                    }
+                }
+
+                //open edges around every vertex and every position
+                std::vector<unsigned> indexOut(vertexCount, 0), indexIn(vertexCount, 0);
+                std::vector<unsigned> positionOut(vertexCount, 0), positionIn(vertexCount, 0);
+                for (size_t i = 0; i < indices.size(); i += 3) {
+                    for (int c = 0; c < 3; c++) {
+                        GLuint a = indices[i + c];
+                        GLuint b = indices[i + (c + 1) % 3];
+                        if (!hasIndexEdge(b, a)) {
+                            indexOut[a]++;
+                            indexIn[b]++;
+                        }
+                        if (!hasPositionEdge(position[b], position[a])) {
+                            positionOut[position[a]]++;
+                            positionIn[position[b]]++;
+                        }
+                    }
+                }
+
+                //vertices still in use at every position
+                std::vector<unsigned> wedgeSize(vertexCount, 0);
+                std::vector<bool> used(vertexCount, false);
+                std::vector<GLuint> firstAt(vertexCount, 0);
+                for (size_t i = 0; i < indices.size(); i++) {
+                    GLuint v = indices[i];
+                    if (used[v]) {
+                        continue;
+                    }
+                    used[v] = true;
+                    GLuint p = position[v];
+                    if (wedgeSize[p]++ == 0) {
+                        firstAt[p] = v;
+                    } else {
+                        twin[v] = firstAt[p];
+                        twin[firstAt[p]] = v;
+                    }
+                }
+
+                for (size_t v = 0; v < vertexCount; v++) {
+                    kind[v] = VERTEX_LOCKED;
+                    if (!used[v]) {
+                        continue;
+                    }
+                    GLuint p = position[v];
+                    bool closed = positionOut[p] == 0 && positionIn[p] == 0;
+                    if (wedgeSize[p] == 1) {
+                        if (closed) {
+                            kind[v] = VERTEX_MANIFOLD;
+                        } else if (positionOut[p] == 1 && positionIn[p] == 1) {
+                            kind[v] = VERTEX_BORDER;
+                        }
+                    } else if (wedgeSize[p] == 2 && closed) {
+                        GLuint other = twin[v];
+                        if (indexOut[v] == 1 && indexIn[v] == 1 && indexOut[other] == 1 && indexIn[other] == 1) {
+                            kind[v] = VERTEX_SEAM;
+                        }
+                    }
+                }
+            }
+
+            bool hasIndexEdge(GLuint from, GLuint to) const {
+                return indexEdges.count(EdgeKey(from, to)) != 0;
+            }
+
+            bool hasPositionEdge(GLuint from, GLuint to) const {
+                return positionEdges.count(EdgeKey(from, to)) != 0;
+            }
+
+            // Whether `from` may move onto `to` without tearing a border or a seam
+            bool canCollapse(GLuint from, GLuint to) const {
+                if (position[from] == position[to]) {
+                    return false;
+                }
+
+                switch (kind[from]) {
+                    case VERTEX_MANIFOLD:
+                        return true;
+                    case VERTEX_BORDER:
+                        //an edge with one triangle is open in both directions
+                        return !hasPositionEdge(position[to], position[from]) || !hasPositionEdge(position[from], position[to]);
+                    case VERTEX_SEAM: {
+                        if (kind[to] != VERTEX_SEAM || (hasIndexEdge(from, to) && hasIndexEdge(to, from))) {
+                            return false;
+                        }
+                        //the other side of the seam has to collapse along the same edge
+                        GLuint otherFrom = twin[from];
+                        GLuint otherTo = twin[to];
+                        return hasIndexEdge(otherFrom, otherTo) != hasIndexEdge(otherTo, otherFrom);
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            VertexKind kindOf(GLuint v) const {
+                return kind[v];
+            }
+
+            GLuint twinOf(GLuint v) const {
+                return twin[v];
+            }
+
+        private:
+            const std::vector<GLuint>& position;
+            std::vector<VertexKind> kind;
+            //the other vertex at the same position, for seam vertices
+            std::vector<GLuint> twin;
+            std::unordered_set<uint64_t> indexEdges;
+            std::unordered_set<uint64_t> positionEdges;
+        };
+
+        // Whether moving every corner at position `from` onto `target` keeps the
+        // triangles around it facing the same way
+        bool KeepsOrientation(const std::vector<GLuint>& indices, const std::vector<GLuint>& position, const Vertex* vertices,
+                              const std::vector<size_t>& firstTriangle, const std::vector<GLuint>& triangles,
+                              GLuint from, GLuint to, const glm::vec3& target) {
+            for (size_t a = firstTriangle[from]; a < firstTriangle[from + 1]; a++) {
+                const GLuint* triangle = &indices[triangles[a] * 3];
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+                bool removed = false;
+                for (int c = 0; c < 3; c++) {
+                    GLuint p = position[triangle[c]];
+                    removed = removed || p == to;
+                    before[c] = vertices[triangle[c]].Position;
+                    after[c] = p == from ? target : before[c];
+                }
+                if (removed) {
+                    continue;
+                }
+
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) <= MIN_NORMAL_COSINE * glm::length(normalBefore) * glm::length(normalAfter)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    void SimplifyMeshLevels(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                            const std::vector<size_t>& targetIndexCounts,
+                            std::vector<std::vector<GLuint> >& levels, std::vector<float>& errors) {
+        std::vector<GLuint> result(indices, indices + indexCount - indexCount % 3);
+        double maxError = 0.0;
+        levels.clear();
+        errors.clear();
+        if (vertexCount == 0 || targetIndexCounts.empty() || result.size() <= targetIndexCounts[0]) {
+            levels.assign(targetIndexCounts.size(), result);
+            errors.assign(targetIndexCounts.size(), 0.0f);
+            return;
+        }
+
+        //every vertex mapped to the first one at its position, so seams read as one surface
+        std::vector<GLuint> position(vertexCount);
+        std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> firstAtPosition;
+        firstAtPosition.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            position[v] = firstAtPosition.insert(std::make_pair(vertices[v].Position, (GLuint)v)).first->second;
+        }
+
+        Topology topology(position, vertexCount);
+        topology.build(result);
+
+        //triangle planes weighted by area, plus planes across open borders holding them in place
+        Quadric zero;
+        memset(&zero, 0, sizeof(zero));
+        std::vector<Quadric> quadrics(vertexCount, zero);
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const glm::vec3& a = vertices[result[i]].Position;
+            const glm::vec3& b = vertices[result[i + 1]].Position;
+            const glm::vec3& c = vertices[result[i + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float doubleArea = glm::length(normal);
+            if (doubleArea <= 0.0f) {
+                continue;
+            }
+            normal = normal / doubleArea;
+            double distance = -glm::dot(normal, a);
+            for (int k = 0; k < 3; k++) {
+                AddPlane(quadrics[position[result[i + k]]], normal, distance, 0.5 * doubleArea);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                GLuint from = position[result[i + k]];
+                GLuint to = position[result[i + (k + 1) % 3]];
+                if (topology.hasPositionEdge(to, from)) {
+                    continue;
+                }
+                glm::vec3 edge = vertices[to].Position - vertices[from].Position;
+                glm::vec3 across = glm::cross(edge, normal);
+                float length = glm::length(across);
+                if (length <= 0.0f) {
+                    continue;
+                }
+                across = across / length;
+                double edgeDistance = -glm::dot(across, vertices[from].Position);
+                double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+                AddPlane(quadrics[from], across, edgeDistance, weight);
+                AddPlane(quadrics[to], across, edgeDistance, weight);
+            }
+        }
+
+        std::vector<Collapse> candidates;
+        std::vector<GLuint> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<size_t> firstTriangle(vertexCount + 1);
+        std::vector<GLuint> triangles;
+
+        //every level continues from the one before, quadrics included
+        bool topologyStale = false;
+        for (size_t level = 0; level < targetIndexCounts.size(); level++) {
+            size_t targetIndexCount = targetIndexCounts[level];
+            for (int pass = 0; pass < MAX_PASSES && result.size() > targetIndexCount; pass++) {
+                if (topologyStale) {
+                    topology.build(result);
+                }
+
+                //triangles around every position
+                std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+                for (size_t i = 0; i < result.size(); i++) {
+                    firstTriangle[position[result[i]] + 1]++;
+                }
+                for (size_t p = 0; p < vertexCount; p++) {
+                    firstTriangle[p + 1] += firstTriangle[p];
+                }
+                triangles.resize(result.size());
+                std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+                for (size_t i = 0; i < result.size(); i++) {
+                    triangles[fill[position[result[i]]]++] = (GLuint)(i / 3);
+                }
+
+                candidates.clear();
+                for (size_t i = 0; i < result.size(); i += 3) {
+                    for (int k = 0; k < 3; k++) {
+                        GLuint a = result[i + k];
+                        GLuint b = result[i + (k + 1) % 3];
+                        if (topology.canCollapse(a, b)) {
+                            Collapse collapse = { a, b, CollapseError(quadrics[position[a]], quadrics[position[b]], vertices[b].Position) };
+                            candidates.push_back(collapse);
+                        }
+                        if (topology.canCollapse(b, a)) {
+                            Collapse collapse = { b, a, CollapseError(quadrics[position[b]], quadrics[position[a]], vertices[a].Position) };
+                            candidates.push_back(collapse);
+                        }
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+
+                for (size_t v = 0; v < vertexCount; v++) {
+                    remap[v] = (GLuint)v;
+                }
+                std::fill(touched.begin(), touched.end(), false);
+
+                //cheapest first; a collapse freezes its neighbourhood for the rest of the pass
+                size_t triangleCount = result.size() / 3;
+                size_t targetTriangles = targetIndexCount / 3;
+                size_t collapses = 0;
+                for (size_t c = 0; c < candidates.size() && triangleCount > targetTriangles; c++) {
+                    const Collapse& collapse = candidates[c];
+                    GLuint from = position[collapse.from];
+                    GLuint to = position[collapse.to];
+                    if (touched[from] || touched[to]) {
+                        continue;
+                    }
+                    if (!KeepsOrientation(result, position, vertices, firstTriangle, triangles, from, to, vertices[collapse.to].Position)) {
+                        continue;
+                    }
+
+                    remap[collapse.from] = collapse.to;
+                    if (topology.kindOf(collapse.from) == VERTEX_SEAM) {
+                        remap[topology.twinOf(collapse.from)] = topology.twinOf(collapse.to);
+                    }
+                    AddQuadric(quadrics[to], quadrics[from]);
+                    maxError = std::max(maxError, collapse.error);
+
+                    for (size_t a = firstTriangle[from]; a < firstTriangle[from + 1]; a++) {
+                        const GLuint* triangle = &result[triangles[a] * 3];
+                        bool removed = false;
+                        for (int k = 0; k < 3; k++) {
+                            touched[position[triangle[k]]] = true;
+                            removed = removed || position[triangle[k]] == to;
+                        }
+                        if (removed) {
+                            triangleCount--;
+                        }
+                    }
+                    collapses++;
+                }
+                if (collapses == 0) {
+                    break;
+                }
+
+                //triangles that lost an edge are gone; positions decide, seam sides may differ in index
+                size_t write = 0;
+                for (size_t i = 0; i < result.size(); i += 3) {
+                    GLuint a = remap[result[i]];
+                    GLuint b = remap[result[i + 1]];
+                    GLuint c = remap[result[i + 2]];
+                    if (position[a] == position[b] || position[b] == position[c] || position[c] == position[a]) {
+                        continue;
+                    }
+                    result[write++] = a;
+                    result[write++] = b;
+                    result[write++] = c;
+                }
+                result.resize(write);
+                topologyStale = true;
+            }
+
+            levels.push_back(result);
+            errors.push_back((float)std::sqrt(maxError));
+        }
+    }
+
+    std::vector<GLuint> SimplifyMesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                                     size_t targetIndexCount, float* error) {
+        std::vector<std::vector<GLuint> > levels;
+        std::vector<float> errors;
+        SimplifyMeshLevels(vertices, vertexCount, indices, indexCount, std::vector<size_t>(1, targetIndexCount), levels, errors);
+        if (error) {
+            *error = errors[0];
+        }
+        return levels[0];
+    }
+
+    void BuildLodChain(MeshData& mesh) {
+        mesh.lods.clear();
+        size_t fullCount = mesh.indices.size() - mesh.indices.size() % 3;
+        if (fullCount == 0) {
+            return;
+        }
+
+        MeshLod full = { 0, (GLuint)fullCount, 0.0f };
+        mesh.lods.push_back(full);
+
+        std::vector<size_t> targets;
+        for (size_t r = 0; r < sizeof(LOD_TRIANGLE_RATIOS) / sizeof(LOD_TRIANGLE_RATIOS[0]); r++) {
+            size_t targetTriangles = (size_t)(fullCount / 3 * LOD_TRIANGLE_RATIOS[r]);
+            if (targetTriangles < MIN_LOD_TRIANGLES) {
+                break;
+            }
+            targets.push_back(targetTriangles * 3);
+        }
+
+        //one run through every target, so each level's error is still measured against the full mesh
+        std::vector<std::vector<GLuint> > levels;
+        std::vector<float> errors;
+        SimplifyMeshLevels(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), fullCount, targets, levels, errors);
+
+        for (size_t l = 0; l < levels.size(); l++) {
+            std::vector<GLuint>& level = levels[l];
+            if (level.size() > mesh.lods.back().indexCount * MIN_LOD_REDUCTION) {
+                break;
+            }
+            OptimizeVertexCache(level.data(), level.size(), mesh.vertices.size());
+
+            MeshLod lod = { (GLuint)mesh.indices.size(), (GLuint)level.size(), errors[l] };
+            mesh.lods.push_back(lod);
+            mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+        }
+    }
+
+    void ReportLodChain(const std::string& meshName, const std::vector<MeshLod>& lods, double seconds) {
+        std::cout << "LOD chain      : " << (meshName.empty() ? "(unnamed)" : meshName);
+        for (size_t i = 0; i < lods.size(); i++) {
+            std::cout << (i == 0 ? " " : ", ") << lods[i].indexCount / 3;
+            if (i > 0) {
+                std::cout << " (" << lods[i].error << ")";
+            }
+        }
+        std::cout << " triangles in " << seconds * 1000.0 << " ms" << std::endl;
+    }
+}
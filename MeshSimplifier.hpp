@@ -0,0 +1,44 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Triangle counts of the generated levels, as fractions of the full mesh
+    const float LOD_TRIANGLE_RATIOS[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+    // Quadric error metric edge collapse (Garland and Heckbert) towards
+    // targetIndexCount, keeping the vertices: every collapse moves a vertex onto
+    // a neighbour, so the result indexes the same vertex array and a level of
+    // detail only needs its own indices. Open borders only collapse along
+    // themselves, and UV or normal seams (vertices sharing a position) only
+    // along the seam, both sides together, so neither tears. Collapses that
+    // would flip a triangle are skipped, which may leave the result above the
+    // target.
+    //
+    // error receives the largest collapse error, a distance in model units.
+    std::vector<GLuint> SimplifyMesh(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                                     size_t targetIndexCount, float* error);
+
+    // The same towards several targets, largest first, in a single run: each
+    // level continues from the one before, its error still measured against
+    // the original mesh. levels and errors receive one entry per target.
+    void SimplifyMeshLevels(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                            const std::vector<size_t>& targetIndexCounts,
+                            std::vector<std::vector<GLuint> >& levels, std::vector<float>& errors);
+
+    // Appends a level per LOD_TRIANGLE_RATIOS to mesh.indices, each ordered for
+    // the vertex cache, and describes them in mesh.lods. Stops early once
+    // simplification stalls.
+    void BuildLodChain(MeshData& mesh);
+
+    // One line per mesh, for the load log
+    void ReportLodChain(const std::string& meshName, const std::vector<MeshLod>& lods, double seconds);
+}
+
+#endif /* MeshSimplifier_hpp */
@@ -0,0 +1,213 @@
+#include "Meshlets.hpp"
+#include "Mesh.hpp"
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        // Below this, the normals of a meshlet spread too far for a useful cone
+        const float MIN_CONE_SPREAD = 0.1f;
+
+        // `positions` is scratch, reused across meshlets
+        void ComputeCullingData(const Vertex* vertices, const GLuint* indices, size_t indexCount,
+                                std::vector<glm::vec3>& positions, Meshlet& meshlet) {
+            positions.resize(indexCount);
+            for (size_t i = 0; i < indexCount; i++) {
+                positions[i] = vertices[indices[i]].Position;
+            }
+            BoundingBox box = ComputeBox(&positions[0], indexCount, sizeof(glm::vec3));
+            BoundingSphere sphere = ComputeSphere(&positions[0], indexCount, sizeof(glm::vec3), box);
+            meshlet.center = sphere.center;
+            meshlet.radius = sphere.radius;
+
+            //the cone around the average face normal holding every normal
+            meshlet.coneApex = meshlet.center;
+            meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+            meshlet.coneCutoff = 1.0f;
+
+            std::vector<glm::vec3> normals;
+            normals.reserve(indexCount / 3);
+            glm::vec3 normalSum(0.0f);
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                const glm::vec3& a = vertices[indices[i]].Position;
+                glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+                float length = glm::length(normal);
+                normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+                normalSum += normals.back();
+            }
+
+            float sumLength = glm::length(normalSum);
+            if (sumLength <= 0.0f) {
+                return;
+            }
+            glm::vec3 axis = normalSum / sumLength;
+
+            float minDot = 1.0f;
+            for (size_t t = 0; t < normals.size(); t++) {
+                minDot = std::min(minDot, glm::dot(normals[t], axis));
+            }
+            if (minDot <= MIN_CONE_SPREAD) {
+                return;
+            }
+
+            //the apex sits far enough back that every triangle's plane passes in front of it
+            float apexDistance = 0.0f;
+            for (size_t t = 0; t < normals.size(); t++) {
+                glm::vec3 corner = vertices[indices[t * 3]].Position;
+                float along = glm::dot(meshlet.center - corner, normals[t]) / glm::dot(axis, normals[t]);
+                apexDistance = std::max(apexDistance, along);
+            }
+
+            meshlet.coneApex = meshlet.center - axis * apexDistance;
+            meshlet.coneAxis = axis;
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+
+        bool InsideFrustum(const Frustum& frustum, const glm::vec3& center, float radius) {
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool BackFacing(const Meshlet& meshlet, const glm::vec3& cameraPosition) {
+            if (meshlet.coneCutoff >= 1.0f) {
+                return false;
+            }
+            glm::vec3 toApex = meshlet.coneApex - cameraPosition;
+            float distance = glm::length(toApex);
+            return distance > 0.0f && glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+        }
+    }
+
+    void BuildMeshlets(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                       std::vector<Meshlet>& meshlets) {
+        meshlets.clear();
+        indexCount -= indexCount % 3;
+        if (indexCount == 0) {
+            return;
+        }
+
+        //meshlet number + 1 of the last meshlet each vertex was counted in
+        std::vector<size_t> seenIn(vertexCount, 0);
+        std::vector<glm::vec3> positions;
+        size_t first = 0;
+        size_t meshletVertices = 0;
+
+        for (size_t i = 0; i <= indexCount; i += 3) {
+            size_t stamp = meshlets.size() + 1;
+            size_t newVertices = 0;
+            if (i < indexCount) {
+                for (int c = 0; c < 3; c++) {
+                    GLuint v = indices[i + c];
+                    //a triangle repeating a vertex still only loads it once
+                    if (seenIn[v] != stamp && (c == 0 || indices[i + c - 1] != v) && (c < 2 || indices[i] != v)) {
+                        newVertices++;
+                    }
+                }
+            }
+
+            bool full = meshletVertices + newVertices > MESHLET_MAX_VERTICES || (i - first) / 3 >= MESHLET_MAX_TRIANGLES;
+            if (i == indexCount || full) {
+                Meshlet meshlet;
+                meshlet.firstIndex = (GLuint)first;
+                meshlet.indexCount = (GLuint)(i - first);
+                ComputeCullingData(vertices, indices + first, i - first, positions, meshlet);
+                meshlets.push_back(meshlet);
+
+                if (i == indexCount) {
+                    break;
+                }
+                first = i;
+                meshletVertices = 0;
+                stamp = meshlets.size() + 1;
+            }
+
+            for (int c = 0; c < 3; c++) {
+                GLuint v = indices[i + c];
+                if (seenIn[v] != stamp) {
+                    seenIn[v] = stamp;
+                    meshletVertices++;
+                }
+            }
+        }
+    }
+
+    void ReportMeshlets(const std::string& meshName, const std::vector<Meshlet>& meshlets) {
+        size_t triangles = 0;
+        size_t withCone = 0;
+        for (size_t i = 0; i < meshlets.size(); i++) {
+            triangles += meshlets[i].indexCount / 3;
+            if (meshlets[i].coneCutoff < 1.0f) {
+                withCone++;
+            }
+        }
+
+        std::cout << "Meshlets       : " << (meshName.empty() ? "(unnamed)" : meshName) << " " << meshlets.size()
+                  << " meshlet(s), " << (meshlets.empty() ? 0.0 : (double)triangles / meshlets.size())
+                  << " triangles each, " << withCone << " with a normal cone" << std::endl;
+    }
+
+    Frustum ExtractFrustum(const glm::mat4& clipFromSpace) {
+        //rows of the matrix; clip space keeps -w <= x, y, z <= w
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; r++) {
+            rows[r] = glm::vec4(clipFromSpace[0][r], clipFromSpace[1][r], clipFromSpace[2][r], clipFromSpace[3][r]);
+        }
+
+        Frustum frustum;
+        for (int axis = 0; axis < 3; axis++) {
+            frustum.planes[axis * 2] = rows[3] + rows[axis];
+            frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+        for (int p = 0; p < 6; p++) {
+            glm::vec4& plane = frustum.planes[p];
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f) {
+                plane = plane / length;
+            }
+        }
+        return frustum;
+    }
+
+    size_t CullMeshlets(const std::vector<Meshlet>& meshlets, const Frustum& frustum, const glm::vec3& cameraPosition,
+                        std::vector<IndexRange>& visible, MeshletCullStats& stats) {
+        size_t appended = 0;
+        //the range being grown, open while the previous meshlet was visible
+        bool open = false;
+
+        for (size_t i = 0; i < meshlets.size(); i++) {
+            const Meshlet& meshlet = meshlets[i];
+            stats.tested++;
+
+            if (!InsideFrustum(frustum, meshlet.center, meshlet.radius)) {
+                stats.frustumCulled++;
+                open = false;
+                continue;
+            }
+            if (BackFacing(meshlet, cameraPosition)) {
+                stats.backfaceCulled++;
+                open = false;
+                continue;
+            }
+
+            if (open && visible.back().firstIndex + visible.back().indexCount == meshlet.firstIndex) {
+                visible.back().indexCount += meshlet.indexCount;
+            } else {
+                IndexRange range = { meshlet.firstIndex, meshlet.indexCount };
+                visible.push_back(range);
+                appended++;
+            }
+            open = true;
+        }
+        return appended;
+    }
+}
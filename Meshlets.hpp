@@ -0,0 +1,78 @@
+#ifndef Meshlets_hpp
+#define Meshlets_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // Limits of one cluster, the usual mesh shader sizes
+    const size_t MESHLET_MAX_VERTICES = 64;
+    const size_t MESHLET_MAX_TRIANGLES = 124;
+
+    // A run of consecutive triangles of a mesh's full level of detail, with
+    // what culling it needs, all in model space
+    struct Meshlet {
+        //offset into the mesh's indices
+        GLuint firstIndex;
+        GLuint indexCount;
+        glm::vec3 center;
+        float radius;
+        //every triangle faces away from a camera inside the cone at coneApex
+        //around -coneAxis; coneCutoff is 1 when the normals spread too far for that
+        glm::vec3 coneApex;
+        glm::vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    // Splits the triangles into meshlets in the order they come, so an index
+    // buffer already ordered for the vertex cache keeps that order and every
+    // meshlet stays a plain index range
+    void BuildMeshlets(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                       std::vector<Meshlet>& meshlets);
+
+    // One line per mesh, for the load log
+    void ReportMeshlets(const std::string& meshName, const std::vector<Meshlet>& meshlets);
+
+    // Six planes (x, y, z, w) with inside where dot(plane.xyz, p) + plane.w >= 0
+    struct Frustum {
+        glm::vec4 planes[6];
+    };
+
+    // Planes of the clip volume of clipFromSpace, in that space; pass
+    // viewProjection * model to get them in model space
+    Frustum ExtractFrustum(const glm::mat4& clipFromSpace);
+
+    struct MeshletCullStats {
+        size_t tested;
+        size_t frustumCulled;
+        size_t backfaceCulled;
+    };
+
+    // A range of indices to draw, meshlets next to each other merged
+    struct IndexRange {
+        GLuint firstIndex;
+        GLuint indexCount;
+    };
+
+    // Appends the index ranges of the meshlets at least partly inside the
+    // frustum and not entirely back facing from cameraPosition; both given in
+    // the meshlets' model space. Returns the number of ranges appended.
+    size_t CullMeshlets(const std::vector<Meshlet>& meshlets, const Frustum& frustum, const glm::vec3& cameraPosition,
+                        std::vector<IndexRange>& visible, MeshletCullStats& stats);
+}
+
+#endif /* Meshlets_hpp */
@@ -0,0 +1,292 @@
+#include "Mipmaps.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_MIP_SSE
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+    #include <arm_neon.h>
+    #define GPS_MIP_NEON
+#endif
+
+namespace gps {
+
+    namespace {
+
+        const uint32_t MIPMAP_CACHE_MAGIC = 0x4D535047; //"GPSM"
+        // Bump whenever the filters change
+        const uint32_t MIPMAP_CACHE_VERSION = 1;
+
+        // One RGBA pixel in linear light, a single SIMD register where available
+#if defined (GPS_MIP_SSE)
+        typedef __m128 Pixel;
+        inline Pixel LoadPixel(const float* p) { return _mm_loadu_ps(p); }
+        inline void StorePixel(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+        inline Pixel ZeroPixel() { return _mm_setzero_ps(); }
+        inline Pixel MultiplyAdd(Pixel sum, Pixel v, float weight) { return _mm_add_ps(sum, _mm_mul_ps(v, _mm_set1_ps(weight))); }
+#elif defined (GPS_MIP_NEON)
+        typedef float32x4_t Pixel;
+        inline Pixel LoadPixel(const float* p) { return vld1q_f32(p); }
+        inline void StorePixel(float* p, Pixel v) { vst1q_f32(p, v); }
+        inline Pixel ZeroPixel() { return vdupq_n_f32(0.0f); }
+        inline Pixel MultiplyAdd(Pixel sum, Pixel v, float weight) { return vmlaq_n_f32(sum, v, weight); }
+#else
+        struct Pixel { float c[4]; };
+        inline Pixel LoadPixel(const float* p) { Pixel v; memcpy(v.c, p, sizeof(v.c)); return v; }
+        inline void StorePixel(float* p, Pixel v) { memcpy(p, v.c, sizeof(v.c)); }
+        inline Pixel ZeroPixel() { Pixel v = { { 0.0f, 0.0f, 0.0f, 0.0f } }; return v; }
+        inline Pixel MultiplyAdd(Pixel sum, Pixel v, float weight) {
+            for (int i = 0; i < 4; i++) {
+                sum.c[i] += v.c[i] * weight;
+            }
+            return sum;
+        }
+#endif
+
+        // Output pixel j of a halved axis reads source pixels 2j + first ... 2j + first + taps - 1
+        struct Kernel {
+            int first;
+            int taps;
+            float weights[6];
+        };
+
+        Kernel BoxKernel() {
+            Kernel kernel = { 0, 2, { 0.5f, 0.5f } };
+            return kernel;
+        }
+
+        double BesselI0(double x) {
+            double sum = 1.0;
+            double term = 1.0;
+            for (int k = 1; k < 32; k++) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        }
+
+        // Sinc at half the source rate, windowed over three source pixels on each side
+        Kernel KaiserKernel() {
+            const double PI = 3.14159265358979323846;
+            const double ALPHA = 4.0;
+            const double RADIUS = 3.0;
+
+            Kernel kernel;
+            kernel.first = -2;
+            kernel.taps = 6;
+
+            double total = 0.0;
+            for (int t = 0; t < kernel.taps; t++) {
+                //distance from the output pixel's center at 2j + 0.5
+                double d = t - 2.5;
+                double x = PI * d / 2.0;
+                double sinc = std::sin(x) / x;
+                double window = BesselI0(ALPHA * std::sqrt(1.0 - (d / RADIUS) * (d / RADIUS))) / BesselI0(ALPHA);
+                kernel.weights[t] = (float)(sinc * window);
+                total += kernel.weights[t];
+            }
+            for (int t = 0; t < kernel.taps; t++) {
+                kernel.weights[t] = (float)(kernel.weights[t] / total);
+            }
+            return kernel;
+        }
+
+        // Halves the width of a linear RGBA float image
+        void DownsampleRows(const float* source, int width, int height, const Kernel& kernel, float* destination) {
+            int half = width / 2;
+            for (int y = 0; y < height; y++) {
+                const float* row = source + (size_t)y * width * 4;
+                float* out = destination + (size_t)y * half * 4;
+                for (int x = 0; x < half; x++) {
+                    Pixel sum = ZeroPixel();
+                    for (int t = 0; t < kernel.taps; t++) {
+                        int sx = std::min(std::max(2 * x + kernel.first + t, 0), width - 1);
+                        sum = MultiplyAdd(sum, LoadPixel(row + sx * 4), kernel.weights[t]);
+                    }
+                    StorePixel(out + x * 4, sum);
+                }
+            }
+        }
+
+        // Halves the height of a linear RGBA float image
+        void DownsampleColumns(const float* source, int width, int height, const Kernel& kernel, float* destination) {
+            int half = height / 2;
+            const float* rows[6];
+            for (int y = 0; y < half; y++) {
+                for (int t = 0; t < kernel.taps; t++) {
+                    int sy = std::min(std::max(2 * y + kernel.first + t, 0), height - 1);
+                    rows[t] = source + (size_t)sy * width * 4;
+                }
+                float* out = destination + (size_t)y * width * 4;
+                for (int x = 0; x < width; x++) {
+                    Pixel sum = ZeroPixel();
+                    for (int t = 0; t < kernel.taps; t++) {
+                        sum = MultiplyAdd(sum, LoadPixel(rows[t] + x * 4), kernel.weights[t]);
+                    }
+                    StorePixel(out + x * 4, sum);
+                }
+            }
+        }
+
+        float SrgbToLinear(float c) {
+            return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        const int ENCODE_BUCKETS = 4096;
+
+        struct SrgbTables {
+            float toLinear[256];
+            //linear value where code c starts, halfway between codes c - 1 and c in sRGB space
+            float thresholds[257];
+            //lowest code of each linear bucket of width 1 / ENCODE_BUCKETS, one step from the answer
+            unsigned char bucketCode[ENCODE_BUCKETS + 1];
+
+            SrgbTables() {
+                for (int c = 0; c < 256; c++) {
+                    toLinear[c] = SrgbToLinear(c / 255.0f);
+                    thresholds[c] = c == 0 ? -1.0f : SrgbToLinear((c - 0.5f) / 255.0f);
+                }
+                thresholds[256] = 2.0f;
+
+                int code = 0;
+                for (int b = 0; b <= ENCODE_BUCKETS; b++) {
+                    while (code < 255 && thresholds[code + 1] <= (float)b / ENCODE_BUCKETS) {
+                        code++;
+                    }
+                    bucketCode[b] = (unsigned char)code;
+                }
+            }
+        };
+
+        const SrgbTables& Srgb() {
+            static const SrgbTables tables;
+            return tables;
+        }
+
+        inline unsigned char LinearToSrgb8(float v, const SrgbTables& tables) {
+            v = std::min(std::max(v, 0.0f), 1.0f);
+            int code = tables.bucketCode[(int)(v * ENCODE_BUCKETS)];
+            //a bucket never spans more than a couple of codes
+            while (v >= tables.thresholds[code + 1]) {
+                code++;
+            }
+            return (unsigned char)code;
+        }
+
+        inline unsigned char LinearToUnorm8(float v) {
+            return (unsigned char)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+        }
+
+        bool SourceStamp(const std::string& imageFileName, MipFilter filter, bool srgb, uint32_t stamp[8]) {
+            struct stat info;
+            if (stat(imageFileName.c_str(), &info) != 0) {
+                return false;
+            }
+
+            uint64_t size = (uint64_t)info.st_size;
+            uint64_t modified = (uint64_t)(int64_t)info.st_mtime;
+            stamp[0] = MIPMAP_CACHE_MAGIC;
+            stamp[1] = MIPMAP_CACHE_VERSION;
+            stamp[2] = (uint32_t)filter;
+            stamp[3] = srgb ? 1 : 0;
+            stamp[4] = (uint32_t)size;
+            stamp[5] = (uint32_t)(size >> 32);
+            stamp[6] = (uint32_t)modified;
+            stamp[7] = (uint32_t)(modified >> 32);
+            return true;
+        }
+    }
+
+    void GenerateMipChain(const unsigned char* rgba, int width, int height, bool srgb, MipFilter filter,
+                          CompressedTexture& chain) {
+        AllocateLevels(BLOCK_RGBA8, srgb, width, height, chain);
+        memcpy(chain.data.data(), rgba, chain.levels[0].size);
+
+        if (chain.levels.size() == 1) {
+            return;
+        }
+
+        // Every level is filtered from the float copy of the one above, so rounding
+        // never accumulates; the base level is converted a row at a time as it is read
+        const SrgbTables& tables = Srgb();
+        Kernel kernel = filter == MIP_FILTER_BOX ? BoxKernel() : KaiserKernel();
+        std::vector<float> current;
+        std::vector<float> halved;
+        std::vector<float> row((size_t)width * 4);
+
+        int firstWidth = width > 1 ? width / 2 : 1;
+        current.resize((size_t)firstWidth * height * 4);
+        for (int y = 0; y < height; y++) {
+            const unsigned char* source = rgba + (size_t)y * width * 4;
+            for (int x = 0; x < width * 4; x += 4) {
+                for (int c = 0; c < 3; c++) {
+                    row[x + c] = srgb ? tables.toLinear[source[x + c]] : source[x + c] / 255.0f;
+                }
+                row[x + 3] = source[x + 3] / 255.0f;
+            }
+            if (width > 1) {
+                DownsampleRows(row.data(), width, 1, kernel, current.data() + (size_t)y * firstWidth * 4);
+            } else {
+                memcpy(current.data() + (size_t)y * 4, row.data(), 4 * sizeof(float));
+            }
+        }
+
+        for (size_t level = 1; level < chain.levels.size(); level++) {
+            int levelWidth = chain.levels[level - 1].width;
+            int levelHeight = chain.levels[level - 1].height;
+
+            if (level == 1) {
+                //the rows were halved while converting
+                levelWidth = firstWidth;
+            } else if (levelWidth > 1) {
+                halved.resize((size_t)(levelWidth / 2) * levelHeight * 4);
+                DownsampleRows(current.data(), levelWidth, levelHeight, kernel, halved.data());
+                current.swap(halved);
+                levelWidth /= 2;
+            }
+            if (levelHeight > 1) {
+                halved.resize((size_t)levelWidth * (levelHeight / 2) * 4);
+                DownsampleColumns(current.data(), levelWidth, levelHeight, kernel, halved.data());
+                current.swap(halved);
+                levelHeight /= 2;
+            }
+
+            unsigned char* out = chain.data.data() + chain.levels[level].offset;
+            size_t count = (size_t)levelWidth * levelHeight;
+            for (size_t i = 0; i < count; i++) {
+                for (int c = 0; c < 3; c++) {
+                    out[i * 4 + c] = srgb ? LinearToSrgb8(current[i * 4 + c], tables) : LinearToUnorm8(current[i * 4 + c]);
+                }
+                out[i * 4 + 3] = LinearToUnorm8(current[i * 4 + 3]);
+            }
+        }
+    }
+
+    std::string MipmapCacheFileName(const std::string& imageFileName) {
+        return imageFileName + ".mips.dds";
+    }
+
+    bool ReadMipmapCache(const std::string& imageFileName, MipFilter filter, CompressedTexture& chain) {
+        if (!ReadDDS(MipmapCacheFileName(imageFileName), chain) || chain.format != BLOCK_RGBA8) {
+            return false;
+        }
+
+        uint32_t stamp[8];
+        return SourceStamp(imageFileName, filter, chain.srgb, stamp) &&
+               memcmp(stamp, chain.userData, sizeof(stamp)) == 0;
+    }
+
+    bool WriteMipmapCache(const std::string& imageFileName, MipFilter filter, CompressedTexture& chain) {
+        if (!SourceStamp(imageFileName, filter, chain.srgb, chain.userData)) {
+            return false;
+        }
+        return WriteDDS(MipmapCacheFileName(imageFileName), chain);
+    }
+}
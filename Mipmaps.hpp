@@ -0,0 +1,30 @@
+#ifndef Mipmaps_hpp
+#define Mipmaps_hpp
+
+#include "TextureFile.hpp"
+
+#include <string>
+
+namespace gps {
+
+    enum MipFilter {
+        MIP_FILTER_BOX,     //2x2 average
+        MIP_FILTER_KAISER   //6-tap Kaiser windowed sinc, keeps distant textures sharper
+    };
+
+    // Builds the full RGBA8 mip chain of an image, level 0 being a copy of it.
+    // With srgb the color channels are filtered in linear light; alpha always is.
+    void GenerateMipChain(const unsigned char* rgba, int width, int height, bool srgb, MipFilter filter,
+                          CompressedTexture& chain);
+
+    // Mip chains generated at load are kept next to the image as <image>.mips.dds
+    std::string MipmapCacheFileName(const std::string& imageFileName);
+
+    // Reads the cached chain if it was built from the image as it is now, with `filter`
+    bool ReadMipmapCache(const std::string& imageFileName, MipFilter filter, CompressedTexture& chain);
+
+    // Stamps chain.userData with the image's size and modification time, then writes the cache
+    bool WriteMipmapCache(const std::string& imageFileName, MipFilter filter, CompressedTexture& chain);
+}
+
+#endif /* Mipmaps_hpp */
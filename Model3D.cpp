@@ -1,36 +1,545 @@
 #include "Model3D.hpp"
+#include "ImageUtils.hpp"
+#include "TextureCache.hpp"
+#include "RenderState.hpp"
+#include "InstanceBuffer.hpp"
+#include "UniformBlocks.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+    #define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+    #define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
 
 namespace gps {
 
+	LodSelection LodSelectionFor(const Camera& camera, float fovy, float viewportHeight, float maxPixelError) {
+
+		LodSelection selection;
+		selection.cameraPosition = camera.getPosition();
+		selection.projectionScale = viewportHeight / (2.0f * std::tan(fovy * 0.5f));
+		selection.maxPixelError = maxPixelError;
+		return selection;
+	}
+
+	ModelLoadHandle::ModelLoadHandle() {
+	}
+
+	ModelLoadHandle::ModelLoadHandle(std::shared_future<void> done)
+		: done(done) {
+	}
+
+	bool ModelLoadHandle::isValid() const {
+
+		return done.valid();
+	}
+
+	bool ModelLoadHandle::isReady() const {
+
+		return done.valid() && done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	void ModelLoadHandle::get() const {
+
+		done.get();
+	}
+
+	namespace {
+
+		// GL internal format for a block compressed texture, 0 if the driver cannot sample it
+		GLenum CompressedInternalFormat(BlockFormat format, bool srgb) {
+#if defined (__APPLE__)
+			bool s3tc = true;
+			bool s3tcSrgb = true;
+			bool bptc = false;
+#else
+			bool s3tc = GLEW_EXT_texture_compression_s3tc != 0;
+			bool s3tcSrgb = s3tc && GLEW_EXT_texture_sRGB;
+			bool bptc = GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+#endif
+			switch (format) {
+			case BLOCK_BC1:
+				if (srgb) {
+					return s3tcSrgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : 0;
+				}
+				return s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : 0;
+			case BLOCK_BC3:
+				if (srgb) {
+					return s3tcSrgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : 0;
+				}
+				return s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+			case BLOCK_BC5:
+				return GL_COMPRESSED_RG_RGTC2;
+			case BLOCK_BC7:
+				if (!bptc) {
+					return 0;
+				}
+				return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+			case BLOCK_RGBA8:
+				return 0;
+			}
+			return 0;
+		}
+
+		bool TextureStorageSupported() {
+#if defined (__APPLE__)
+			return false;
+#else
+			return GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+#endif
+		}
+
+		// Uploads every level of a mip chain into the bound texture; returns the bytes used.
+		// The storage is immutable where glTexStorage2D exists, so the driver allocates it once.
+		size_t UploadLevels(const CompressedTexture& texture) {
+
+			GLenum compressedFormat = texture.format == BLOCK_RGBA8 ? 0 : CompressedInternalFormat(texture.format, texture.srgb);
+			GLenum internalFormat = compressedFormat != 0 ? compressedFormat : (texture.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+			bool immutable = TextureStorageSupported();
+			size_t bytes = 0;
+			std::vector<unsigned char> expanded;
+
+			if (immutable) {
+				glTexStorage2D(GL_TEXTURE_2D, (GLsizei)texture.levels.size(), internalFormat,
+							   texture.levels[0].width, texture.levels[0].height);
+			}
+
+			for (size_t i = 0; i < texture.levels.size(); i++) {
+
+				const TextureLevel& level = texture.levels[i];
+				const unsigned char* data = texture.data.data() + level.offset;
+
+				if (compressedFormat != 0) {
+
+					if (immutable) {
+						glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height,
+												  compressedFormat, (GLsizei)level.size, data);
+					} else {
+						glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, compressedFormat, level.width, level.height, 0,
+											   (GLsizei)level.size, data);
+					}
+					bytes += level.size;
+					continue;
+				}
+
+				if (texture.format != BLOCK_RGBA8) {
+
+					// no hardware support (BC7 on macOS), expand the blocks on the CPU
+					expanded.resize((size_t)level.width * level.height * 4);
+					DecompressImage(data, level.width, level.height, texture.format, expanded.data());
+					data = expanded.data();
+				}
+
+				if (immutable) {
+					glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+				} else {
+					glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0,
+								 GL_RGBA, GL_UNSIGNED_BYTE, data);
+				}
+				bytes += (size_t)level.width * level.height * 4;
+			}
+
+			if (!immutable) {
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+			}
+
+			return bytes;
+		}
+
+		// Open-addressing (linear probing) hash map from an OBJ index triple to
+		// the position of the welded vertex that was emitted for it
+		class VertexWeldMap {
+
+		public:
+			// The table never grows: it is sized for the worst case where every
+			// face corner is unique, at a load factor of at most 1/2
+			explicit VertexWeldMap(size_t maxKeys) {
+
+				size_t capacity = 16;
+				while (capacity < maxKeys * 2) {
+					capacity <<= 1;
+				}
+
+				Slot empty;
+				empty.key.vertex_index = 0;
+				empty.key.normal_index = 0;
+				empty.key.texcoord_index = 0;
+				empty.value = EMPTY_SLOT;
+
+				slots.assign(capacity, empty);
+				mask = capacity - 1;
+			}
+
+			// Returns the value stored for key, or stores and returns newValue
+			// if the key was not seen before
+			GLuint findOrInsert(const tinyobj::index_t& key, GLuint newValue) {
+
+				size_t slot = hash(key) & mask;
+
+				while (slots[slot].value != EMPTY_SLOT) {
+
+					const tinyobj::index_t& other = slots[slot].key;
+
+					if (other.vertex_index == key.vertex_index &&
+						other.normal_index == key.normal_index &&
+						other.texcoord_index == key.texcoord_index) {
+
+						return slots[slot].value;
+					}
+
+					slot = (slot + 1) & mask;
+				}
+
+				slots[slot].key = key;
+				slots[slot].value = newValue;
+
+				return newValue;
+			}
+
+		private:
+			static const GLuint EMPTY_SLOT = 0xFFFFFFFFu;
+
+			struct Slot {
+				tinyobj::index_t key;
+				GLuint value;
+			};
+
+			std::vector<Slot> slots;
+			size_t mask;
+
+			static size_t hash(const tinyobj::index_t& key) {
+
+				uint32_t h = (uint32_t)key.vertex_index * 0x9E3779B1u;
+				h ^= (uint32_t)key.normal_index * 0x85EBCA77u;
+				h ^= (uint32_t)key.texcoord_index * 0xC2B2AE3Du;
+
+				// murmur3 finalizer, spreads the bits over the whole word
+				h ^= h >> 16;
+				h *= 0x85EBCA6Bu;
+				h ^= h >> 13;
+				h *= 0xC2B2AE35u;
+				h ^= h >> 16;
+
+				return h;
+			}
+		};
+
+		// Assembles the vertex referenced by one face corner
+		gps::Vertex BuildVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& idx, bool flipTexCoords) {
+
+			gps::Vertex vertex;
+
+			vertex.Position = glm::vec3(
+				attrib.vertices[3 * idx.vertex_index + 0],
+				attrib.vertices[3 * idx.vertex_index + 1],
+				attrib.vertices[3 * idx.vertex_index + 2]);
+
+			vertex.Normal = glm::vec3(0.0f);
+			if (idx.normal_index != -1) {
+
+				vertex.Normal = glm::vec3(
+					attrib.normals[3 * idx.normal_index + 0],
+					attrib.normals[3 * idx.normal_index + 1],
+					attrib.normals[3 * idx.normal_index + 2]);
+			}
+
+			vertex.TexCoords = glm::vec2(0.0f);
+			if (idx.texcoord_index != -1) {
+
+				vertex.TexCoords = glm::vec2(
+					attrib.texcoords[2 * idx.texcoord_index + 0],
+					attrib.texcoords[2 * idx.texcoord_index + 1]);
+
+				// images are uploaded top row first, GL samples them bottom row first
+				if (flipTexCoords) {
+					vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+				}
+			}
+
+			return vertex;
+		}
+	}
+
 	void Model3D::LoadModel(std::string fileName) {
 
-        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, ModelLoadOptions());
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
 
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath, ModelLoadOptions());
+	}
+
+	void Model3D::LoadModel(std::string fileName, const ModelLoadOptions& options) {
+
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		LoadModel(fileName, basePath, options);
+	}
+
+    void Model3D::LoadModel(std::string fileName, std::string basePath, const ModelLoadOptions& options) {
+
+		PreparedModel prepared;
+
+		if (!PrepareModel(fileName, basePath, options, prepared)) {
+
+			exit(1);
+		}
+
+		for (size_t i = 0; i < prepared.images.size(); i++) {
+
+			UploadTexture(prepared, i);
+		}
+
+		for (size_t i = 0; i < prepared.meshTextures.size(); i++) {
+
+			UploadMesh(prepared, i);
+		}
+	}
+
+	ModelLoadHandle Model3D::LoadModelAsync(std::string fileName, const ModelLoadOptions& options,
+											ThreadPool& workers, UploadQueue& uploads) {
+
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		return LoadModelAsync(fileName, basePath, options, workers, uploads);
+	}
+
+	ModelLoadHandle Model3D::LoadModelAsync(std::string fileName, std::string basePath, const ModelLoadOptions& options,
+											ThreadPool& workers, UploadQueue& uploads) {
+
+		std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+		ModelLoadHandle handle(done->get_future().share());
+
+		UploadQueue* queue = &uploads;
+
+		workers.submit([this, fileName, basePath, options, queue, done]() {
+
+			std::shared_ptr<PreparedModel> prepared = std::make_shared<PreparedModel>();
+
+			try {
+
+				if (!PrepareModel(fileName, basePath, options, *prepared)) {
+
+					throw std::runtime_error("could not load " + fileName);
+				}
+			} catch (...) {
+
+				done->set_exception(std::current_exception());
+				return;
+			}
+
+			// Textures go first, the meshes refer to their ids
+			for (size_t i = 0; i < prepared->images.size(); i++) {
+
+				queue->push([this, prepared, i]() { UploadTexture(*prepared, i); });
+			}
+
+			for (size_t i = 0; i < prepared->meshTextures.size(); i++) {
+
+				queue->push([this, prepared, i]() { UploadMesh(*prepared, i); });
+			}
+
+			queue->push([done]() { done->set_value(); });
+		});
+
+		return handle;
+	}
+
+	// Reads or parses the geometry and decodes the textures, without any GL call
+	bool Model3D::PrepareModel(std::string fileName, std::string basePath, const ModelLoadOptions& options, PreparedModel& prepared) {
+
+        std::cout << "Loading : " << fileName << std::endl;
+
+		std::vector<std::vector<gps::TextureRef> > references;
+
+		uint32_t bakeFlags = options.flipTexCoords ? BAKE_FLIPPED_TEXCOORDS : 0;
+		if (options.optimizeMeshes) {
+
+			bakeFlags |= BAKE_OPTIMIZED_MESHES;
+		}
+		if (options.generateLods) {
+
+			bakeFlags |= BAKE_LOD_CHAINS;
+		}
+		if (options.buildMeshlets) {
+
+			bakeFlags |= BAKE_MESHLETS;
+		}
+
+		if (options.useMeshCache && prepared.cache.open(fileName, bakeFlags)) {
+
+			std::cout << "Mesh cache     : " << MeshCache::cacheFileName(fileName) << std::endl;
+			std::cout << "# of meshes    : " << prepared.cache.meshCount() << std::endl;
+
+			// The geometry goes straight from the mapped cache to the GPU
+			for (size_t i = 0; i < prepared.cache.meshCount(); i++) {
+
+				prepared.cachedMeshes.push_back(prepared.cache.mesh(i));
+				references.push_back(prepared.cachedMeshes.back().textures);
+			}
+		} else {
+
+			std::vector<std::string> materialLibraries;
+			if (!ReadOBJ(fileName, basePath, options, prepared.parsedMeshes, materialLibraries)) {
+
+				return false;
+			}
+
+			// Baked into the cache, so later loads get the optimized order for free
+			if (options.optimizeMeshes) {
+
+				for (size_t i = 0; i < prepared.parsedMeshes.size(); i++) {
+
+					gps::MeshData& data = prepared.parsedMeshes[i];
+					ReportMeshOptimization(data.name, OptimizeMesh(data.vertices, data.indices));
+				}
+			}
+
+			if (options.generateLods) {
+
+				for (size_t i = 0; i < prepared.parsedMeshes.size(); i++) {
+
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					gps::MeshData& data = prepared.parsedMeshes[i];
+					BuildLodChain(data);
+					ReportLodChain(data.name, data.lods, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				}
+			}
+
+			if (options.buildMeshlets) {
+
+				// Level 0 only, the coarser levels are small enough to draw whole
+				for (size_t i = 0; i < prepared.parsedMeshes.size(); i++) {
+
+					gps::MeshData& data = prepared.parsedMeshes[i];
+					size_t fullCount = data.lods.empty() ? data.indices.size() : data.lods[0].indexCount;
+					BuildMeshlets(data.vertices.data(), data.vertices.size(), data.indices.data(), fullCount, data.meshlets);
+					ReportMeshlets(data.name, data.meshlets);
+				}
+			}
+
+			if (options.useMeshCache && !MeshCache::write(fileName, basePath, materialLibraries, prepared.parsedMeshes, bakeFlags)) {
+
+				std::cerr << "WARNING: could not write mesh cache " << MeshCache::cacheFileName(fileName) << std::endl;
+			}
+
+			for (size_t i = 0; i < prepared.parsedMeshes.size(); i++) {
+
+				references.push_back(prepared.parsedMeshes[i].textures);
+			}
+		}
+
+		// Meshes flagged for picking or physics keep their CPU copy, the others follow the default
+		for (size_t i = 0; i < references.size(); i++) {
+
+			const std::string& name = prepared.cachedMeshes.empty() ? prepared.parsedMeshes[i].name : prepared.cachedMeshes[i].name;
+			bool keepCpuCopy = std::find(options.cpuResidentMeshes.begin(), options.cpuResidentMeshes.end(), name) != options.cpuResidentMeshes.end();
+			prepared.meshResidency.push_back(keepCpuCopy ? MESH_KEEP_CPU_COPY : options.residency);
+		}
+
+		if (options.vertexEncoding == VERTEX_QUANTIZED) {
+
+			prepared.quantizedMeshes.resize(references.size());
+			for (size_t i = 0; i < references.size(); i++) {
+
+				if (prepared.cachedMeshes.empty()) {
+
+					const gps::MeshData& data = prepared.parsedMeshes[i];
+					QuantizeVertices(data.vertices.data(), data.vertices.size(), prepared.quantizedMeshes[i]);
+					ReportQuantization(data.name, prepared.quantizedMeshes[i]);
+				} else {
+
+					const gps::MeshView& view = prepared.cachedMeshes[i];
+					QuantizeVertices(view.vertices, view.vertexCount, prepared.quantizedMeshes[i]);
+					ReportQuantization(view.name, prepared.quantizedMeshes[i]);
+				}
+			}
+		}
+
+		PrepareTextures(references, basePath, options, prepared);
+
+		return true;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	void Model3D::Draw(const gps::Shader& shaderProgram) {
 
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	void Model3D::Draw(const gps::Shader& shaderProgram, const glm::mat4& model, const LodSelection& selection) {
+
+		UniformBlocks& blocks = UniformBlocks::shared();
+		blocks.setObject(blocks.objectUniforms(model));
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(shaderProgram, meshes[i].selectLod(model, selection));
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count) {
+
+		if (count == 0 || meshes.empty())
+			return;
+
+		//one upload shared by every mesh of the model; the object block only carries the meshes' position decode
+		InstanceBuffer::shared().upload(transforms, count);
+		UniformBlocks& blocks = UniformBlocks::shared();
+		blocks.setObject(blocks.objectUniforms(glm::mat4(1.0f)));
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shaderProgram, (GLsizei)count);
+		InstanceBuffer::shared().fence();
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const std::vector<glm::mat4>& transforms) {
+
+		if (!transforms.empty())
+			DrawInstanced(shaderProgram, &transforms[0], transforms.size());
+	}
+
+	const std::vector<gps::Mesh>& Model3D::getMeshes() const {
+
+		return meshes;
+	}
+
+	std::vector<gps::Mesh>& Model3D::getMeshes() {
+
+		return meshes;
+	}
+
+	const Bounds& Model3D::getBounds() const {
+
+		return bounds;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath, const ModelLoadOptions& options,
+						  std::vector<gps::MeshData>& meshData, std::vector<std::string>& materialLibraries) {
 
-        std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		gps::ObjLoadStats stats;
+		bool ret = gps::LoadObjMapped(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE, &stats, options.threadCount);
 
 		if (!err.empty()) {
 
@@ -40,18 +549,38 @@ namespace gps {
 
 		if (!ret) {
 
-			exit(1);
+			return false;
 		}
 
+		materialLibraries = stats.materialLibraries;
+
+		double megabytes = stats.bytes / (1024.0 * 1024.0);
+		std::cout << "Parsed         : " << megabytes << " MB in " << stats.seconds * 1000.0 << " ms (";
+		// a small file can parse within the clock's resolution
+		if (stats.seconds > 0.0) {
+
+			std::cout << megabytes / stats.seconds << " MB/s, ";
+		}
+		std::cout << stats.chunks << " chunk(s))" << std::endl;
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		meshData.resize(shapes.size());
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			meshData[s].name = shapes[s].name;
+			std::vector<gps::Vertex>& vertices = meshData[s].vertices;
+			std::vector<GLuint>& indices = meshData[s].indices;
+			std::vector<gps::TextureRef>& textures = meshData[s].textures;
+
+			const size_t cornerCount = shapes[s].mesh.indices.size();
+			indices.reserve(cornerCount);
+
+			// Every distinct (position, normal, texcoord) triple becomes one vertex,
+			// face corners that repeat a triple reuse the already emitted vertex
+			VertexWeldMap weldMap(cornerCount);
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -59,47 +588,35 @@ namespace gps {
 
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
-
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
 
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
-					float vx = attrib.vertices[3 * idx.vertex_index + 0];
-					float vy = attrib.vertices[3 * idx.vertex_index + 1];
-					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
-					float tx = 0.0f;
-					float ty = 0.0f;
+					GLuint candidate = (GLuint)vertices.size();
+					GLuint vertexIndex = weldMap.findOrInsert(idx, candidate);
 
-					if (idx.texcoord_index != -1) {
+					if (vertexIndex == candidate) {
 
-						tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-						ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+						vertices.push_back(BuildVertex(attrib, idx, options.flipTexCoords));
 					}
 
-					glm::vec3 vertexPosition(vx, vy, vz);
-					glm::vec3 vertexNormal(nx, ny, nz);
-					glm::vec2 vertexTexCoords(tx, ty);
-
-					gps::Vertex currentVertex;
-					currentVertex.Position = vertexPosition;
-					currentVertex.Normal = vertexNormal;
-					currentVertex.TexCoords = vertexTexCoords;
-
-					vertices.push_back(currentVertex);
-
-					indices.push_back((GLuint)(index_offset + v));
+					indices.push_back(vertexIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			std::cout << "# of vertices  : " << vertices.size() << " unique / " << cornerCount << " face corners" << std::endl;
+
+			meshData[s].bounds = ComputeBounds(vertices.data(), vertices.size());
+
+			gps::Material& currentMaterial = meshData[s].material;
+			currentMaterial.ambient = glm::vec3(0.0f);
+			currentMaterial.diffuse = glm::vec3(0.0f);
+			currentMaterial.specular = glm::vec3(0.0f);
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			size_t a = shapes[s].mesh.material_ids.size();
@@ -109,74 +626,341 @@ namespace gps {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
 
-					gps::Material currentMaterial;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
 
+					gps::TextureRef currentTexture;
+
 					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
+					currentTexture.type = "ambientTexture";
+					currentTexture.name = materials[materialId].ambient_texname;
 
-					if (!ambientTexturePath.empty()) {
+					if (!currentTexture.name.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
 						textures.push_back(currentTexture);
 					}
 
 					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
+					currentTexture.type = "diffuseTexture";
+					currentTexture.name = materials[materialId].diffuse_texname;
 
-					if (!diffuseTexturePath.empty()) {
+					if (!currentTexture.name.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
 						textures.push_back(currentTexture);
 					}
 
 					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
+					currentTexture.type = "specularTexture";
+					currentTexture.name = materials[materialId].specular_texname;
 
-					if (!specularTexturePath.empty()) {
+					if (!currentTexture.name.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
 						textures.push_back(currentTexture);
 					}
 				}
 			}
-
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
 		}
+
+		return true;
 	}
 
-	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	// Collects the unique textures referenced by the meshes' materials and decodes them
+	void Model3D::PrepareTextures(const std::vector<std::vector<gps::TextureRef> >& references, std::string basePath,
+								  const ModelLoadOptions& options, PreparedModel& prepared) {
+
+		prepared.meshTextures.resize(references.size());
+
+		TextureCache& cache = TextureCache::shared();
+		std::unordered_map<std::string, size_t> imageIndex;
+		std::vector<size_t> pending;
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
+		for (size_t m = 0; m < references.size(); m++) {
 
-				if (loadedTextures[i].path == path)	{
+			for (size_t t = 0; t < references[m].size(); t++) {
 
-					//already loaded texture
-					return loadedTextures[i];
+				std::string path = TextureCache::canonicalPath(basePath + references[m][t].name);
+
+				std::unordered_map<std::string, size_t>::iterator found = imageIndex.find(path);
+				size_t image;
+
+				if (found == imageIndex.end()) {
+
+					image = prepared.images.size();
+					imageIndex[path] = image;
+
+					TextureImage decoded;
+					decoded.path = path;
+					// images loaded without flipTexCoords have their rows the other way up
+					decoded.cacheKey = options.flipTexCoords ? path : path + "#flipped";
+					decoded.width = 0;
+					decoded.height = 0;
+					decoded.id = 0;
+					decoded.decodeSeconds = 0.0;
+
+					// textures another model already uploaded are not decoded again
+					if (cache.acquire(decoded.cacheKey, &decoded.id)) {
+
+						std::cout << "Texture        : " << path << " shared" << std::endl;
+					} else {
+
+						pending.push_back(image);
+					}
+
+					prepared.images.push_back(decoded);
+				} else {
+
+					image = found->second;
 				}
+
+				TextureBinding binding;
+				binding.image = image;
+				binding.type = references[m][t].type;
+				prepared.meshTextures[m].push_back(binding);
 			}
+		}
+
+		if (pending.empty()) {
+
+			return;
+		}
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-			loadedTextures.push_back(currentTexture);
+		// Every image decodes independently; the uploads keep the collection order
+		unsigned int threadCount = std::min(ThreadPool::resolveThreadCount(options.threadCount),
+											(unsigned int)pending.size());
 
-			return currentTexture;
+		std::vector<char> succeeded(pending.size(), 0);
+
+		if (threadCount > 1) {
+
+			ThreadPool decoders(threadCount);
+			std::vector<std::future<bool> > decoded;
+
+			// every decode is waited for below, while `options` is still alive
+			const ModelLoadOptions* imageOptions = &options;
+			for (size_t i = 0; i < pending.size(); i++) {
+
+				TextureImage* image = &prepared.images[pending[i]];
+				decoded.push_back(decoders.submit([image, imageOptions]() { return ReadTexture(*imageOptions, *image); }));
+			}
+
+			for (size_t i = 0; i < decoded.size(); i++) {
+
+				succeeded[i] = decoded[i].get();
+			}
+		} else {
+
+			for (size_t i = 0; i < pending.size(); i++) {
+
+				succeeded[i] = ReadTexture(options, prepared.images[pending[i]]);
+			}
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		size_t failed = 0;
+		for (size_t i = 0; i < pending.size(); i++) {
+
+			TextureImage& image = prepared.images[pending[i]];
+			if (!succeeded[i]) {
+
+				// nothing left to upload, the meshes using it draw untextured
+				image.pixels.reset();
+				image.chain.reset();
+				std::cout << "Texture        : " << image.path << " could not be decoded, skipped" << std::endl;
+				failed++;
+				continue;
+			}
+
+			std::cout << "Texture        : " << image.path << " (" << image.width << "x" << image.height;
+			if (image.chain) {
+				std::cout << " " << BlockFormatName(image.chain->format) << ", " << image.chain->levels.size() << " levels";
+			}
+			std::cout << ") decoded in " << image.decodeSeconds * 1000.0 << " ms" << std::endl;
+		}
+
+		std::cout << "# of textures  : " << pending.size() - failed << " decoded in " << seconds * 1000.0 << " ms on "
+				  << threadCount << " thread(s), " << prepared.images.size() - pending.size() << " shared, "
+				  << failed << " failed" << std::endl;
+	}
+
+	// Loads one decoded texture into video memory
+	void Model3D::UploadTexture(PreparedModel& prepared, size_t image) {
+
+		TextureImage& decoded = prepared.images[image];
+
+		if (decoded.chain) {
+
+			TextureHandle texture = TextureHandle::create();
+			RenderState::current().bindTexture(0, texture.get());
+			texture.setBytes(UploadLevels(*decoded.chain));
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+							decoded.chain->levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			decoded.id = TextureCache::shared().insert(decoded.cacheKey, std::move(texture));
+		} else if (decoded.pixels) {
+
+			TextureHandle texture = TextureHandle::create();
+			RenderState::current().bindTexture(0, texture.get());
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				0,
+				GL_SRGB, //GL_SRGB,//GL_RGBA,
+				decoded.width,
+				decoded.height,
+				0,
+				GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				decoded.pixels.get()
+			);
+			glGenerateMipmap(GL_TEXTURE_2D);
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			// RGBA8 plus a third for the mip chain
+			size_t bytes = (size_t)decoded.width * decoded.height * 4;
+			texture.setBytes(bytes + bytes / 3);
+			decoded.id = TextureCache::shared().insert(decoded.cacheKey, std::move(texture));
+		}
+
+		if (decoded.id != 0) {
+
+			gps::Texture texture;
+			texture.id = decoded.id;
+			texture.path = decoded.cacheKey;
+			loadedTextures.push_back(texture);
+		}
+
+		// the pixels are in video memory now
+		decoded.pixels.reset();
+		decoded.chain.reset();
+	}
+
+	// Creates the GL buffers of one prepared mesh; its textures must be uploaded already
+	void Model3D::UploadMesh(PreparedModel& prepared, size_t mesh) {
+
+		std::vector<gps::Texture> textures;
+
+		for (size_t t = 0; t < prepared.meshTextures[mesh].size(); t++) {
+
+			const TextureBinding& binding = prepared.meshTextures[mesh][t];
+
+			gps::Texture texture;
+			texture.id = prepared.images[binding.image].id;
+			texture.type = binding.type;
+			texture.path = prepared.images[binding.image].path;
+			textures.push_back(texture);
+		}
+
+		QuantizedMesh* quantized = prepared.quantizedMeshes.empty() ? NULL : &prepared.quantizedMeshes[mesh];
+
+		if (!prepared.cachedMeshes.empty()) {
+
+			const gps::MeshView& view = prepared.cachedMeshes[mesh];
+			meshes.emplace_back(view.vertices, view.vertexCount, view.indices, view.indexCount, std::move(textures),
+								prepared.meshResidency[mesh], quantized, view.lods, &view.bounds);
+			meshes.back().name = view.name;
+			meshes.back().setMeshlets(view.meshlets);
+		} else {
+
+			// each mesh is uploaded once, so the parsed geometry is handed over rather than copied
+			gps::MeshData& data = prepared.parsedMeshes[mesh];
+			meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures),
+								prepared.meshResidency[mesh], quantized, std::move(data.lods), &data.bounds);
+			meshes.back().name = data.name;
+			meshes.back().setMeshlets(std::move(data.meshlets));
+		}
+
+		//grows as the meshes of an asynchronous load come in
+		bounds = MergeBounds(bounds, meshes.back().getBounds());
+
+		if (quantized) {
+
+			std::vector<QuantizedVertex>().swap(quantized->vertices);
+		}
+	}
+
+	// Reads a compressed version of the texture if there is one, the image file otherwise,
+	// and builds its mip chain when options.precomputeMipmaps is set
+	bool Model3D::ReadTexture(const ModelLoadOptions& options, TextureImage& image) {
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool referencedCompressed = IsCompressedTextureFile(image.path);
+
+		if (referencedCompressed || (options.useCompressedTextures && options.flipTexCoords)) {
+
+			std::string fileName = referencedCompressed ? image.path : CompressedTextureFileName(image.path);
+			std::shared_ptr<CompressedTexture> compressed = std::make_shared<CompressedTexture>();
+
+			if (ReadCompressedTexture(fileName, *compressed)) {
+
+				image.width = compressed->levels[0].width;
+				image.height = compressed->levels[0].height;
+				image.chain = compressed;
+				image.decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				return true;
+			}
+
+			if (referencedCompressed) {
+				fprintf(stderr, "ERROR: could not load %s\n", image.path.c_str());
+				return false;
+			}
+		}
+
+		if (!options.precomputeMipmaps) {
+
+			return ReadTextureFromFile(image.path.c_str(), !options.flipTexCoords, image);
+		}
+
+		// The cache keeps the rows in file order, flipping is cheap enough to redo
+		std::shared_ptr<CompressedTexture> chain = std::make_shared<CompressedTexture>();
+
+		if (!ReadMipmapCache(image.path, options.mipFilter, *chain)) {
+
+			if (!ReadTextureFromFile(image.path.c_str(), false, image)) {
+				return false;
+			}
+
+			GenerateMipChain(image.pixels.get(), image.width, image.height, true, options.mipFilter, *chain);
+			image.pixels.reset();
+
+			if (!WriteMipmapCache(image.path, options.mipFilter, *chain)) {
+				fprintf(stderr, "WARNING: could not write %s\n", MipmapCacheFileName(image.path).c_str());
+			}
+		}
+
+		if (!options.flipTexCoords) {
+			for (size_t i = 0; i < chain->levels.size(); i++) {
+				const TextureLevel& level = chain->levels[i];
+				FlipRowsVertically(chain->data.data() + level.offset, level.width, level.height, 4);
+			}
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		image.width = chain->levels[0].width;
+		image.height = chain->levels[0].height;
+		image.chain = chain;
+		image.decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	// Reads the pixel data from an image file
+	bool Model3D::ReadTextureFromFile(const char* file_name, bool flipRows, TextureImage& image) {
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
 		int x, y, n;
 		int force_channels = 4;
+		// rows stay in file order, see ModelLoadOptions::flipTexCoords
+		stbi_set_flip_vertically_on_load_thread(0);
 		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
 
 		if (!image_data) {
@@ -190,67 +974,38 @@ namespace gps {
 			);
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-
-			for (int col = 0; col < width_in_bytes; col++) {
-
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
+		// GL expects the first row at the bottom
+		if (flipRows) {
+			FlipRowsVertically(image_data, x, y, force_channels);
 		}
 
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		image.width = x;
+		image.height = y;
+		image.pixels = std::shared_ptr<unsigned char>(image_data, stbi_image_free);
+		image.decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		return true;
+	}
 
-		return textureID;
+	Model3D::Model3D()
+		: bounds(EmptyBounds()) {
 	}
 
 	Model3D::~Model3D() {
 
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
+		Unload();
+	}
 
-            glDeleteTextures(1, &loadedTextures.at(i).id);
-        }
+	void Model3D::Unload() {
 
-        for (size_t i = 0; i < meshes.size(); i++) {
+		// the meshes delete their own buffers, the textures stay resident in the shared cache until evicted
+		meshes.clear();
+		bounds = EmptyBounds();
+
+        for (size_t i = 0; i < loadedTextures.size(); i++) {
 
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            TextureCache::shared().release(loadedTextures.at(i).path);
         }
+        loadedTextures.clear();
 	}
 }
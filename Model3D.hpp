@@ -2,41 +2,196 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "Camera.hpp"
+#include "ObjParser.hpp"
+#include "MeshCache.hpp"
+#include "TextureFile.hpp"
+#include "Mipmaps.hpp"
+#include "ThreadPool.hpp"
+#include "UploadQueue.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace gps {
 
+    struct ModelLoadOptions {
+        //threads used to parse the .obj file and decode its textures, 0 = all hardware threads
+        unsigned int threadCount = 0;
+        //load from / bake to the binary cache next to the .obj file
+        bool useMeshCache = true;
+        //mirror the V texture coordinate in the mesh instead of flipping every
+        //decoded image upside down, which makes texture loading a plain copy
+        bool flipTexCoords = true;
+        //load bricks.dds instead of bricks.jpg when present (see tools/texconv.cpp);
+        //block compressed rows cannot be flipped, so this needs flipTexCoords
+        bool useCompressedTextures = true;
+        //build gamma-correct mip chains on the loader threads and keep them in
+        //<image>.mips.dds, instead of running glGenerateMipmap on the render thread
+        bool precomputeMipmaps = true;
+        MipFilter mipFilter = MIP_FILTER_KAISER;
+        //what each mesh keeps in RAM once it is in video memory
+        MeshResidency residency = MESH_GPU_ONLY;
+        //meshes, by their name in the .obj file, that keep a full CPU copy whatever
+        //residency says, e.g. the ones used for picking or physics
+        std::vector<std::string> cpuResidentMeshes;
+        //VERTEX_QUANTIZED halves the vertex size, encoded on the loader threads;
+        //the error of each mesh is logged
+        VertexEncoding vertexEncoding = VERTEX_FLOAT;
+        //reorder the triangles and vertices of each parsed mesh for the
+        //post-transform cache and less overdraw (see MeshOptimizer.hpp)
+        bool optimizeMeshes = true;
+        //bake coarser levels of detail of each parsed mesh (see MeshSimplifier.hpp)
+        //for Draw() to pick from by screen-space error
+        bool generateLods = true;
+        //split each parsed mesh into meshlets with culling bounds (see
+        //Meshlets.hpp), baked into the cache, so IndirectRenderer can skip the
+        //parts out of view or facing away
+        bool buildMeshlets = true;
+    };
+
+    // Picks levels of detail for the camera, with a perspective projection of
+    // vertical field of view fovy (radians) onto viewportHeight pixels
+    LodSelection LodSelectionFor(const Camera& camera, float fovy, float viewportHeight, float maxPixelError = 1.0f);
+
+    // Tracks a model loaded with Model3D::LoadModelAsync
+    class ModelLoadHandle {
+
+    public:
+        ModelLoadHandle();
+        explicit ModelLoadHandle(std::shared_future<void> done);
+
+        //false for a handle no load was started for
+        bool isValid() const;
+        //true once every upload of the model ran, or the load failed
+        bool isReady() const;
+        //rethrows the error of a failed load; only call it once isReady()
+        void get() const;
+
+    private:
+        std::shared_future<void> done;
+    };
+
     class Model3D {
 
     public:
+        Model3D();
         ~Model3D();
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		void LoadModel(std::string fileName, const ModelLoadOptions& options);
+
+		void LoadModel(std::string fileName, std::string basePath, const ModelLoadOptions& options);
+
+		// Parses the model and decodes its textures on `workers`, then queues the
+		// GL uploads on `uploads`, which must be drained by the thread owning the
+		// GL context. Meshes appear in Draw() as their uploads run. The model and
+		// the upload queue must outlive the load.
+		ModelLoadHandle LoadModelAsync(std::string fileName, const ModelLoadOptions& options,
+									   ThreadPool& workers, UploadQueue& uploads);
+
+		ModelLoadHandle LoadModelAsync(std::string fileName, std::string basePath, const ModelLoadOptions& options,
+									   ThreadPool& workers, UploadQueue& uploads);
+
+		void Draw(const gps::Shader& shaderProgram);
+
+		// Draws each mesh at the coarsest level of detail that stays within the
+		// selection's pixel error. Replaces the bound object block with `model`.
+		void Draw(const gps::Shader& shaderProgram, const glm::mat4& model, const LodSelection& selection);
+
+		// Draws one copy per model matrix with a shader built from
+		// shaders/instanced.vert, one glDrawElementsInstanced per mesh. Replaces
+		// the bound object block.
+		void DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count);
+		void DrawInstanced(const gps::Shader& shaderProgram, const std::vector<glm::mat4>& transforms);
+
+		// Deletes the meshes and releases the textures, so the model can be loaded
+		// again; not while an asynchronous load of it is still running
+		void Unload();
+
+		// Meshes uploaded so far; their CPU copies depend on ModelLoadOptions::residency
+		const std::vector<gps::Mesh>& getMeshes() const;
+		std::vector<gps::Mesh>& getMeshes();
+
+		// Union of the bounds of the meshes uploaded so far, in model space;
+		// empty before the first one. TransformBounds() gives the world bounds
+		// under a model matrix.
+		const Bounds& getBounds() const;
 
     private:
+		// Texture file decoded on the CPU, waiting for upload
+		struct TextureImage {
+			//canonical path of the image
+			std::string path;
+			//key into the shared TextureCache
+			std::string cacheKey;
+			int width;
+			int height;
+			std::shared_ptr<unsigned char> pixels;
+			//complete mip chain (block compressed or RGBA8), used instead of pixels when present
+			std::shared_ptr<CompressedTexture> chain;
+			//set before the upload when the texture was already resident
+			GLuint id;
+			double decodeSeconds;
+		};
+
+		struct TextureBinding {
+			//index into PreparedModel::images
+			size_t image;
+			std::string type;
+		};
+
+		// Everything a load produces before it needs the GL context
+		struct PreparedModel {
+			//keeps the mapped geometry alive when the model comes from the cache
+			MeshCache cache;
+			std::vector<gps::MeshView> cachedMeshes;
+			std::vector<gps::MeshData> parsedMeshes;
+			std::vector<TextureImage> images;
+			std::vector<std::vector<TextureBinding> > meshTextures;
+			std::vector<MeshResidency> meshResidency;
+			//empty unless the load asked for VERTEX_QUANTIZED
+			std::vector<QuantizedMesh> quantizedMeshes;
+		};
+
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
+		Bounds bounds;
+		// References held on the shared TextureCache (path is the cache key), released with the model
         std::vector<gps::Texture> loadedTextures;
 
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		bool ReadOBJ(std::string fileName, std::string basePath, const ModelLoadOptions& options,
+					 std::vector<gps::MeshData>& meshData, std::vector<std::string>& materialLibraries);
+
+		// Reads or parses the geometry and decodes the textures, without any GL call
+		bool PrepareModel(std::string fileName, std::string basePath, const ModelLoadOptions& options, PreparedModel& prepared);
+
+		// Collects the unique textures referenced by the meshes' materials and decodes them
+		void PrepareTextures(const std::vector<std::vector<gps::TextureRef> >& references, std::string basePath,
+							 const ModelLoadOptions& options, PreparedModel& prepared);
+
+		// Loads one decoded texture into video memory
+		void UploadTexture(PreparedModel& prepared, size_t image);
+
+		// Creates the GL buffers of one prepared mesh; its textures must be uploaded already
+		void UploadMesh(PreparedModel& prepared, size_t mesh);
 
-		// Retrieves a texture associated with the object - by its name and type
-		gps::Texture LoadTexture(std::string path, std::string type);
+		// Reads a compressed version of the texture if there is one, the image file otherwise,
+		// and builds its mip chain when options.precomputeMipmaps is set
+		static bool ReadTexture(const ModelLoadOptions& options, TextureImage& image);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Reads the pixel data from an image file
+		static bool ReadTextureFromFile(const char* file_name, bool flipRows, TextureImage& image);
     };
 }
 
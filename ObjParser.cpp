@@ -0,0 +1,657 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace gps {
+
+    namespace {
+
+        inline bool isSpace(char c) {
+            return c == ' ' || c == '\t';
+        }
+
+        inline bool isDigit(char c) {
+            return (unsigned int)(c - '0') < 10u;
+        }
+
+        inline const char* skipSpace(const char* p, const char* end) {
+            while (p < end && isSpace(*p)) {
+                p++;
+            }
+            return p;
+        }
+
+        inline const char* skipToken(const char* p, const char* end) {
+            while (p < end && !isSpace(*p) && *p != '\r') {
+                p++;
+            }
+            return p;
+        }
+
+        // Powers of ten that are exactly representable as doubles
+        const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        // Scans [sign] digits [. digits] [(e|E) [sign] digits] starting at p.
+        // Returns the first character after the number, or p if there is no number.
+        const char* scanFloat(const char* p, const char* end, float* result) {
+            const char* start = p;
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = (*p == '-');
+                p++;
+            }
+
+            //keep at most 18 significant digits, that is already past float precision
+            const uint64_t MANTISSA_LIMIT = 100000000000000000ULL;
+            uint64_t mantissa = 0;
+            int exponent = 0;
+            bool anyDigit = false;
+
+            while (p < end && isDigit(*p)) {
+                if (mantissa < MANTISSA_LIMIT) {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                } else {
+                    exponent++;
+                }
+                anyDigit = true;
+                p++;
+            }
+
+            if (p < end && *p == '.') {
+                p++;
+                while (p < end && isDigit(*p)) {
+                    if (mantissa < MANTISSA_LIMIT) {
+                        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                        exponent--;
+                    }
+                    anyDigit = true;
+                    p++;
+                }
+            }
+
+            if (!anyDigit) {
+                return start;
+            }
+
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                const char* q = p + 1;
+                bool negativeExponent = false;
+                if (q < end && (*q == '-' || *q == '+')) {
+                    negativeExponent = (*q == '-');
+                    q++;
+                }
+
+                if (q < end && isDigit(*q)) {
+                    int value = 0;
+                    while (q < end && isDigit(*q)) {
+                        if (value < 10000) {
+                            value = value * 10 + (*q - '0');
+                        }
+                        q++;
+                    }
+                    exponent += negativeExponent ? -value : value;
+                    p = q;
+                }
+            }
+
+            double value = (double)mantissa;
+            if (exponent < 0 && exponent >= -22) {
+                value /= POW10[-exponent];
+            } else if (exponent > 0 && exponent <= 22) {
+                value *= POW10[exponent];
+            } else if (exponent != 0) {
+                value *= std::pow(10.0, exponent);
+            }
+
+            *result = (float)(negative ? -value : value);
+            return p;
+        }
+
+        // Scans [sign] digits starting at p.
+        // Returns the first character after the number, or p if there is no number.
+        const char* scanInt(const char* p, const char* end, int* result) {
+            const char* start = p;
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = (*p == '-');
+                p++;
+            }
+
+            if (p == end || !isDigit(*p)) {
+                return start;
+            }
+
+            int value = 0;
+            while (p < end && isDigit(*p)) {
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+
+            *result = negative ? -value : value;
+            return p;
+        }
+
+        // Reads one whitespace separated float, like tinyobj's parseFloat a token
+        // that is not a number yields defaultValue
+        inline float readFloat(const char** p, const char* end, float defaultValue) {
+            float value = defaultValue;
+            const char* q = skipSpace(*p, end);
+            q = scanFloat(q, end, &value);
+            *p = skipToken(q, end);
+            return value;
+        }
+
+        // Make index zero-base, and also support relative index.
+        inline int fixIndex(int idx, int n) {
+            if (idx > 0) return idx - 1;
+            if (idx == 0) return 0;
+            return n + idx;  // negative value = relative
+        }
+
+        inline std::string readName(const char* p, const char* end) {
+            p = skipSpace(p, end);
+            return std::string(p, skipToken(p, end));
+        }
+
+        struct ChunkEvent {
+            enum Type { GROUP, OBJECT, USEMTL, MTLLIB };
+
+            Type type;
+            //number of faces of the chunk that precede the event
+            size_t face;
+            std::string name;
+        };
+
+        // Everything one line-aligned slice of the file contributes. Positive
+        // indices are already global; relative (negative) ones are resolved
+        // against the chunk-local attribute counts and listed in the relative*
+        // arrays, so stitching only has to add the attributes of earlier chunks.
+        struct ObjChunk {
+            std::vector<float> vertices;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+
+            std::vector<tinyobj::index_t> indices;
+            std::vector<unsigned char> numFaceVertices;
+
+            std::vector<size_t> relativeVertices;
+            std::vector<size_t> relativeNormals;
+            std::vector<size_t> relativeTexcoords;
+
+            std::vector<ChunkEvent> events;
+        };
+
+        enum RelativeFlags {
+            RELATIVE_VERTEX = 1,
+            RELATIVE_NORMAL = 2,
+            RELATIVE_TEXCOORD = 4
+        };
+
+        struct FaceCorner {
+            tinyobj::index_t index;
+            int relative;
+        };
+
+        // Resolves one index of a face corner; 0 is left as 0 like tinyobj does
+        inline int resolveIndex(int idx, int n, int flag, int* relative) {
+            if (idx < 0) {
+                *relative |= flag;
+            }
+            return fixIndex(idx, n);
+        }
+
+        // Parses i, i/j, i//k or i/j/k
+        const char* parseTriple(const char* p, const char* end, const ObjChunk& chunk, FaceCorner* corner) {
+            int vsize = (int)(chunk.vertices.size() / 3);
+            int vnsize = (int)(chunk.normals.size() / 3);
+            int vtsize = (int)(chunk.texcoords.size() / 2);
+            int value = 0;
+
+            tinyobj::index_t& idx = corner->index;
+            idx.vertex_index = -1;
+            idx.normal_index = -1;
+            idx.texcoord_index = -1;
+            corner->relative = 0;
+
+            p = scanInt(p, end, &value);
+            idx.vertex_index = resolveIndex(value, vsize, RELATIVE_VERTEX, &corner->relative);
+            if (p == end || *p != '/') {
+                return p;
+            }
+            p++;
+
+            // i//k
+            if (p < end && *p == '/') {
+                p++;
+                value = 0;
+                p = scanInt(p, end, &value);
+                idx.normal_index = resolveIndex(value, vnsize, RELATIVE_NORMAL, &corner->relative);
+                return p;
+            }
+
+            // i/j/k or i/j
+            value = 0;
+            p = scanInt(p, end, &value);
+            idx.texcoord_index = resolveIndex(value, vtsize, RELATIVE_TEXCOORD, &corner->relative);
+            if (p == end || *p != '/') {
+                return p;
+            }
+            p++;
+
+            value = 0;
+            p = scanInt(p, end, &value);
+            idx.normal_index = resolveIndex(value, vnsize, RELATIVE_NORMAL, &corner->relative);
+            return p;
+        }
+
+        inline void emitCorner(const FaceCorner& corner, ObjChunk& chunk) {
+            if (corner.relative) {
+                size_t slot = chunk.indices.size();
+                if (corner.relative & RELATIVE_VERTEX) chunk.relativeVertices.push_back(slot);
+                if (corner.relative & RELATIVE_NORMAL) chunk.relativeNormals.push_back(slot);
+                if (corner.relative & RELATIVE_TEXCOORD) chunk.relativeTexcoords.push_back(slot);
+            }
+            chunk.indices.push_back(corner.index);
+        }
+
+        void parseFace(const char* p, const char* end, bool triangulate,
+                       std::vector<FaceCorner>& face, ObjChunk& chunk) {
+            face.clear();
+
+            p = skipSpace(p, end);
+            while (p < end && *p != '\r') {
+                FaceCorner corner;
+                p = parseTriple(p, end, chunk, &corner);
+                face.push_back(corner);
+                //drop whatever is left of a malformed corner
+                p = skipToken(p, end);
+                p = skipSpace(p, end);
+            }
+
+            if (face.size() < 3) {
+                return;
+            }
+
+            if (triangulate) {
+                // Polygon -> triangle fan conversion
+                for (size_t k = 2; k < face.size(); k++) {
+                    emitCorner(face[0], chunk);
+                    emitCorner(face[k - 1], chunk);
+                    emitCorner(face[k], chunk);
+                    chunk.numFaceVertices.push_back(3);
+                }
+            } else {
+                for (size_t k = 0; k < face.size(); k++) {
+                    emitCorner(face[k], chunk);
+                }
+                chunk.numFaceVertices.push_back((unsigned char)face.size());
+            }
+        }
+
+        inline bool startsWith(const char* p, const char* end, const char* keyword, size_t length) {
+            return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+        }
+
+        inline void pushEvent(ObjChunk& chunk, ChunkEvent::Type type, const char* p, const char* end) {
+            ChunkEvent event;
+            event.type = type;
+            event.face = chunk.numFaceVertices.size();
+            event.name = readName(p, end);
+            chunk.events.push_back(event);
+        }
+
+        void parseLine(const char* p, const char* end, bool triangulate,
+                       std::vector<FaceCorner>& face, ObjChunk& chunk) {
+            p = skipSpace(p, end);
+            if (p == end) {
+                return;
+            }
+
+            const size_t remaining = (size_t)(end - p);
+
+            switch (*p) {
+                case 'v':
+                    if (remaining > 1 && isSpace(p[1])) {
+                        // vertex
+                        p += 2;
+                        chunk.vertices.push_back(readFloat(&p, end, 0.0f));
+                        chunk.vertices.push_back(readFloat(&p, end, 0.0f));
+                        chunk.vertices.push_back(readFloat(&p, end, 0.0f));
+                    } else if (remaining > 2 && p[1] == 'n' && isSpace(p[2])) {
+                        // normal
+                        p += 3;
+                        chunk.normals.push_back(readFloat(&p, end, 0.0f));
+                        chunk.normals.push_back(readFloat(&p, end, 0.0f));
+                        chunk.normals.push_back(readFloat(&p, end, 0.0f));
+                    } else if (remaining > 2 && p[1] == 't' && isSpace(p[2])) {
+                        // texcoord
+                        p += 3;
+                        chunk.texcoords.push_back(readFloat(&p, end, 0.0f));
+                        chunk.texcoords.push_back(readFloat(&p, end, 0.0f));
+                    }
+                    return;
+
+                case 'f':
+                    if (remaining > 1 && isSpace(p[1])) {
+                        parseFace(p + 2, end, triangulate, face, chunk);
+                    }
+                    return;
+
+                case 'g':
+                    if (remaining > 1 && isSpace(p[1])) {
+                        pushEvent(chunk, ChunkEvent::GROUP, p + 2, end);
+                    }
+                    return;
+
+                case 'o':
+                    if (remaining > 1 && isSpace(p[1])) {
+                        pushEvent(chunk, ChunkEvent::OBJECT, p + 2, end);
+                    }
+                    return;
+
+                case 'u':
+                    if (startsWith(p, end, "usemtl", 6)) {
+                        pushEvent(chunk, ChunkEvent::USEMTL, p + 7, end);
+                    }
+                    return;
+
+                case 'm':
+                    if (startsWith(p, end, "mtllib", 6)) {
+                        pushEvent(chunk, ChunkEvent::MTLLIB, p + 7, end);
+                    }
+                    return;
+
+                default:
+                    // comments and unknown commands
+                    return;
+            }
+        }
+
+        void parseChunk(const char* p, const char* end, bool triangulate, ObjChunk* chunk) {
+            std::vector<FaceCorner> face;
+
+            while (p < end) {
+                const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+                const char* next = lineEnd ? lineEnd + 1 : end;
+                if (!lineEnd) {
+                    lineEnd = end;
+                }
+
+                // Trim '\r' of '\r\n' line endings
+                if (lineEnd > p && lineEnd[-1] == '\r') {
+                    lineEnd--;
+                }
+
+                parseLine(p, lineEnd, triangulate, face, *chunk);
+                p = next;
+            }
+        }
+
+        // Splits [data, data + size) into at most chunkCount slices that all end on a line break
+        std::vector<const char*> splitLines(const char* data, size_t size, size_t chunkCount) {
+            const char* end = data + size;
+
+            std::vector<const char*> bounds;
+            bounds.push_back(data);
+
+            for (size_t i = 1; i < chunkCount; i++) {
+                const char* cut = data + size / chunkCount * i;
+                if (cut <= bounds.back()) {
+                    continue;
+                }
+
+                const char* lineEnd = (const char*)memchr(cut, '\n', (size_t)(end - cut));
+                if (!lineEnd) {
+                    break;
+                }
+                bounds.push_back(lineEnd + 1);
+            }
+
+            if (bounds.back() != end) {
+                bounds.push_back(end);
+            }
+            return bounds;
+        }
+
+        // Adds the attributes of the preceding chunks to the relative indices
+        // and copies the chunk attributes to their final place
+        void relocateChunk(ObjChunk& chunk, int vertexBase, int normalBase, int texcoordBase,
+                           tinyobj::attrib_t* attrib, size_t vertexOffset, size_t normalOffset, size_t texcoordOffset) {
+            for (size_t i = 0; i < chunk.relativeVertices.size(); i++) {
+                chunk.indices[chunk.relativeVertices[i]].vertex_index += vertexBase;
+            }
+            for (size_t i = 0; i < chunk.relativeNormals.size(); i++) {
+                chunk.indices[chunk.relativeNormals[i]].normal_index += normalBase;
+            }
+            for (size_t i = 0; i < chunk.relativeTexcoords.size(); i++) {
+                chunk.indices[chunk.relativeTexcoords[i]].texcoord_index += texcoordBase;
+            }
+
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + vertexOffset);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + normalOffset);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + texcoordOffset);
+        }
+
+        struct ShapeBuilder {
+            std::vector<tinyobj::shape_t>* shapes;
+            std::vector<tinyobj::material_t>* materials;
+            std::string* err;
+            tinyobj::MaterialFileReader* materialReader;
+            std::vector<std::string> materialLibraries;
+
+            std::map<std::string, int> materialMap;
+            int material;
+            std::string name;
+            tinyobj::shape_t shape;
+
+            void flushShape() {
+                if (!shape.mesh.indices.empty()) {
+                    shape.name = name;
+                    shapes->push_back(std::move(shape));
+                }
+                shape = tinyobj::shape_t();
+            }
+
+            // Appends the faces [firstFace, lastFace) of the chunk, whose first corner is *corner
+            void appendFaces(const ObjChunk& chunk, size_t firstFace, size_t lastFace, size_t* corner) {
+                if (firstFace == lastFace) {
+                    return;
+                }
+
+                size_t cornerCount = 0;
+                for (size_t f = firstFace; f < lastFace; f++) {
+                    cornerCount += chunk.numFaceVertices[f];
+                }
+
+                tinyobj::mesh_t& mesh = shape.mesh;
+                mesh.indices.insert(mesh.indices.end(),
+                                    chunk.indices.begin() + *corner,
+                                    chunk.indices.begin() + *corner + cornerCount);
+                mesh.num_face_vertices.insert(mesh.num_face_vertices.end(),
+                                              chunk.numFaceVertices.begin() + firstFace,
+                                              chunk.numFaceVertices.begin() + lastFace);
+                mesh.material_ids.insert(mesh.material_ids.end(), lastFace - firstFace, material);
+
+                *corner += cornerCount;
+            }
+
+            void applyEvent(const ChunkEvent& event) {
+                switch (event.type) {
+                    case ChunkEvent::GROUP:
+                    case ChunkEvent::OBJECT:
+                        flushShape();
+                        name = event.name;
+                        break;
+
+                    case ChunkEvent::USEMTL: {
+                        std::map<std::string, int>::const_iterator it = materialMap.find(event.name);
+                        material = (it != materialMap.end()) ? it->second : -1;
+                        break;
+                    }
+
+                    case ChunkEvent::MTLLIB: {
+                        std::string errMtl;
+                        (*materialReader)(event.name, materials, &materialMap, &errMtl);
+                        materialLibraries.push_back(event.name);
+                        if (err) {
+                            (*err) += errMtl;
+                        }
+                        break;
+                    }
+                }
+            }
+
+            void addChunk(const ObjChunk& chunk) {
+                size_t face = 0;
+                size_t corner = 0;
+
+                for (size_t i = 0; i < chunk.events.size(); i++) {
+                    appendFaces(chunk, face, chunk.events[i].face, &corner);
+                    face = chunk.events[i].face;
+                    applyEvent(chunk.events[i]);
+                }
+
+                appendFaces(chunk, face, chunk.numFaceVertices.size(), &corner);
+            }
+        };
+
+        // Slices smaller than this are not worth handing to another thread
+        const size_t MIN_CHUNK_BYTES = 1 << 20;
+    }
+
+    bool LoadObjMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                       std::vector<tinyobj::material_t>* materials, std::string* err,
+                       const char* fileName, const char* mtlBasePath,
+                       bool triangulate, ObjLoadStats* stats, unsigned int threadCount) {
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (stats) {
+            *stats = ObjLoadStats();
+        }
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file;
+        if (!file.open(fileName)) {
+            if (err) {
+                (*err) = std::string("Cannot open file [") + fileName + "]\n";
+            }
+            return false;
+        }
+
+        threadCount = ThreadPool::resolveThreadCount(threadCount);
+
+        //a few slices per thread keep the workers busy when line lengths vary over the file
+        size_t chunkCount = 1;
+        if (threadCount > 1) {
+            chunkCount = std::min((size_t)threadCount * 4, file.size() / MIN_CHUNK_BYTES);
+            chunkCount = std::max(chunkCount, (size_t)1);
+        }
+
+        std::vector<const char*> bounds = splitLines(file.data(), file.size(), chunkCount);
+        std::vector<ObjChunk> chunks(bounds.size() > 1 ? bounds.size() - 1 : 0);
+
+        // Parse the slices
+        std::unique_ptr<ThreadPool> pool;
+        if (chunks.size() > 1) {
+            pool.reset(new ThreadPool(std::min(threadCount, (unsigned int)chunks.size())));
+
+            std::vector<std::future<void> > parsed;
+            for (size_t c = 0; c < chunks.size(); c++) {
+                ObjChunk* chunk = &chunks[c];
+                const char* chunkBegin = bounds[c];
+                const char* chunkEnd = bounds[c + 1];
+                parsed.push_back(pool->submit([=]() { parseChunk(chunkBegin, chunkEnd, triangulate, chunk); }));
+            }
+            for (size_t c = 0; c < parsed.size(); c++) {
+                parsed[c].get();
+            }
+        } else if (chunks.size() == 1) {
+            parseChunk(bounds[0], bounds[1], triangulate, &chunks[0]);
+        }
+
+        // Prefix sums of the attribute counts give every slice its global base
+        std::vector<size_t> vertexOffsets(chunks.size() + 1, 0);
+        std::vector<size_t> normalOffsets(chunks.size() + 1, 0);
+        std::vector<size_t> texcoordOffsets(chunks.size() + 1, 0);
+
+        for (size_t c = 0; c < chunks.size(); c++) {
+            vertexOffsets[c + 1] = vertexOffsets[c] + chunks[c].vertices.size();
+            normalOffsets[c + 1] = normalOffsets[c] + chunks[c].normals.size();
+            texcoordOffsets[c + 1] = texcoordOffsets[c] + chunks[c].texcoords.size();
+        }
+
+        attrib->vertices.resize(vertexOffsets.back());
+        attrib->normals.resize(normalOffsets.back());
+        attrib->texcoords.resize(texcoordOffsets.back());
+
+        std::vector<std::future<void> > relocated;
+        for (size_t c = 0; c < chunks.size(); c++) {
+            ObjChunk* chunk = &chunks[c];
+            int vertexBase = (int)(vertexOffsets[c] / 3);
+            int normalBase = (int)(normalOffsets[c] / 3);
+            int texcoordBase = (int)(texcoordOffsets[c] / 2);
+            size_t vertexOffset = vertexOffsets[c];
+            size_t normalOffset = normalOffsets[c];
+            size_t texcoordOffset = texcoordOffsets[c];
+
+            std::function<void()> relocate = [=]() {
+                relocateChunk(*chunk, vertexBase, normalBase, texcoordBase,
+                              attrib, vertexOffset, normalOffset, texcoordOffset);
+            };
+
+            if (pool) {
+                relocated.push_back(pool->submit(relocate));
+            } else {
+                relocate();
+            }
+        }
+        for (size_t c = 0; c < relocated.size(); c++) {
+            relocated[c].get();
+        }
+
+        // Group the faces into shapes, in file order
+        tinyobj::MaterialFileReader materialReader(mtlBasePath ? mtlBasePath : "");
+
+        ShapeBuilder builder;
+        builder.shapes = shapes;
+        builder.materials = materials;
+        builder.err = err;
+        builder.materialReader = &materialReader;
+        builder.material = -1;
+
+        for (size_t c = 0; c < chunks.size(); c++) {
+            builder.addChunk(chunks[c]);
+            //release the slice as soon as it has been copied
+            std::vector<tinyobj::index_t>().swap(chunks[c].indices);
+        }
+        builder.flushShape();
+
+        if (stats) {
+            stats->bytes = file.size();
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats->chunks = (unsigned int)chunks.size();
+            stats->materialLibraries.swap(builder.materialLibraries);
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Filled in by a successful load, zero otherwise
+    struct ObjLoadStats {
+        size_t bytes = 0;
+        double seconds = 0.0;
+        //number of line-aligned slices the file was parsed in
+        unsigned int chunks = 0;
+        //.mtl files named by mtllib, relative to the material base path
+        std::vector<std::string> materialLibraries;
+    };
+
+    // Loads an .obj file by mapping it into memory and parsing the mapped bytes
+    // in place, without copying lines into strings. Fills the same structures as
+    // tinyobj::LoadObj; the .mtl files are still read through tinyobj::LoadMtl.
+    // Returns false if the file cannot be opened. `err` receives warnings.
+    //
+    // With threadCount != 1 large files are split into line-aligned slices that
+    // are parsed in parallel and stitched back in file order (0 = all hardware
+    // threads). Relative face indices are resolved across slice boundaries.
+    bool LoadObjMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                       std::vector<tinyobj::material_t>* materials, std::string* err,
+                       const char* fileName, const char* mtlBasePath = NULL,
+                       bool triangulate = true, ObjLoadStats* stats = NULL,
+                       unsigned int threadCount = 1);
+}
+
+#endif /* ObjParser_hpp */
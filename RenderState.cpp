@@ -0,0 +1,129 @@
+#include "RenderState.hpp"
+
+namespace gps {
+
+    const GLuint RenderState::UNKNOWN;
+
+    RenderState& RenderState::current() {
+        static RenderState state;
+        return state;
+    }
+
+    RenderState::RenderState() {
+        invalidate();
+        resetStats();
+    }
+
+    void RenderState::useProgram(GLuint program) {
+        if (this->program == program) {
+            counters.callsSkipped++;
+            return;
+        }
+
+        glUseProgram(program);
+        this->program = program;
+        counters.callsIssued++;
+    }
+
+    void RenderState::bindVertexArray(GLuint vertexArray) {
+        if (this->vertexArray == vertexArray) {
+            counters.callsSkipped++;
+            return;
+        }
+
+        glBindVertexArray(vertexArray);
+        this->vertexArray = vertexArray;
+        counters.callsIssued++;
+    }
+
+    void RenderState::bindTexture(GLuint unit, GLuint texture) {
+        if (unit >= textures.size()) {
+            textures.resize(unit + 1, UNKNOWN);
+        }
+        if (textures[unit] == texture) {
+            counters.callsSkipped++;
+            return;
+        }
+
+        if (activeUnit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            counters.callsIssued++;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        textures[unit] = texture;
+        counters.callsIssued++;
+    }
+
+    void RenderState::drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+        glDrawElements(mode, count, type, indices);
+        counters.callsIssued++;
+        counters.drawCalls++;
+    }
+
+    void RenderState::drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex) {
+        glDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+        counters.callsIssued++;
+        counters.drawCalls++;
+    }
+
+    void RenderState::drawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                      GLsizei instanceCount, GLint baseVertex) {
+        glDrawElementsInstancedBaseVertex(mode, count, type, indices, instanceCount, baseVertex);
+        counters.callsIssued++;
+        counters.drawCalls++;
+    }
+
+    void RenderState::multiDrawElementsBaseVertex(GLenum mode, const GLsizei* counts, GLenum type, const void* const* indices,
+                                                  GLsizei drawCount, const GLint* baseVertices) {
+        glMultiDrawElementsBaseVertex(mode, counts, type, indices, drawCount, baseVertices);
+        counters.callsIssued++;
+        counters.drawCalls += drawCount;
+    }
+
+    void RenderState::multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount) {
+#if !defined (__APPLE__)
+        glMultiDrawElementsIndirect(mode, type, indirect, drawCount, 0);
+        counters.callsIssued++;
+        counters.drawCalls += drawCount;
+#endif
+    }
+
+    void RenderState::forgetProgram(GLuint program) {
+        //a deleted program stays in use until another one is, so its state is unknown
+        if (this->program == program) {
+            this->program = UNKNOWN;
+        }
+    }
+
+    void RenderState::forgetVertexArray(GLuint vertexArray) {
+        if (this->vertexArray == vertexArray) {
+            this->vertexArray = 0;
+        }
+    }
+
+    void RenderState::forgetTexture(GLuint texture) {
+        for (size_t unit = 0; unit < textures.size(); unit++) {
+            if (textures[unit] == texture) {
+                textures[unit] = 0;
+            }
+        }
+    }
+
+    void RenderState::invalidate() {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        textures.clear();
+    }
+
+    RenderStateStats RenderState::stats() const {
+        return counters;
+    }
+
+    void RenderState::resetStats() {
+        counters.callsIssued = 0;
+        counters.callsSkipped = 0;
+        counters.drawCalls = 0;
+    }
+}
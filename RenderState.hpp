@@ -0,0 +1,78 @@
+#ifndef RenderState_hpp
+#define RenderState_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    struct RenderStateStats {
+        size_t callsIssued;     //GL calls that reached the driver, draws included
+        size_t callsSkipped;    //binds dropped because the object was bound already
+        size_t drawCalls;
+    };
+
+    // Shadow copy of the GL state that changes between draws: the program, the
+    // vertex array and the 2D texture bound on each texture unit. Binds that
+    // would not change anything are dropped before they reach the driver.
+    //
+    // GL state belongs to a context, so there is one RenderState and it may only
+    // be used on the thread owning the context. Code binding these objects
+    // directly must call invalidate() afterwards, and deleted objects must be
+    // forgotten so a recycled name is not mistaken for the one still bound.
+    class RenderState {
+
+    public:
+        static RenderState& current();
+
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        // Binds a GL_TEXTURE_2D on a texture unit, switching the active unit only when needed
+        void bindTexture(GLuint unit, GLuint texture);
+
+        void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+        void drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex);
+        void drawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                             GLsizei instanceCount, GLint baseVertex);
+        // GL 3.2, one range per draw; counted as one call
+        void multiDrawElementsBaseVertex(GLenum mode, const GLsizei* counts, GLenum type, const void* const* indices,
+                                         GLsizei drawCount, const GLint* baseVertices);
+        // GL 4.3; counted as one call however many draws the indirect buffer holds
+        void multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount);
+
+        // GL unbinds deleted objects from the context, the shadow copy does the same
+        void forgetProgram(GLuint program);
+        void forgetVertexArray(GLuint vertexArray);
+        void forgetTexture(GLuint texture);
+
+        // Forgets everything, so the next bind of each kind reaches GL
+        void invalidate();
+
+        RenderStateStats stats() const;
+        void resetStats();
+
+    private:
+        //a binding nothing is known about, never a valid GL name
+        static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        std::vector<GLuint> textures;
+        RenderStateStats counters;
+
+        RenderState();
+        RenderState(const RenderState&);
+        RenderState& operator=(const RenderState&);
+    };
+}
+
+#endif /* RenderState_hpp */
@@ -7,9 +7,48 @@
 //
 
 #include "Shader.hpp"
+#include "RenderState.hpp"
+#include "UniformBlocks.hpp"
+
+#include <vector>
 
 namespace gps {
-    std::string Shader::readShaderFile(std::string fileName) {
+
+    namespace {
+
+        bool IsSamplerType(GLenum type) {
+            switch (type) {
+                case GL_SAMPLER_1D:
+                case GL_SAMPLER_2D:
+                case GL_SAMPLER_3D:
+                case GL_SAMPLER_CUBE:
+                case GL_SAMPLER_1D_SHADOW:
+                case GL_SAMPLER_2D_SHADOW:
+                case GL_SAMPLER_1D_ARRAY:
+                case GL_SAMPLER_2D_ARRAY:
+                case GL_SAMPLER_1D_ARRAY_SHADOW:
+                case GL_SAMPLER_2D_ARRAY_SHADOW:
+                case GL_SAMPLER_CUBE_SHADOW:
+                case GL_SAMPLER_2D_MULTISAMPLE:
+                case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+                case GL_SAMPLER_BUFFER:
+                case GL_SAMPLER_2D_RECT:
+                case GL_SAMPLER_2D_RECT_SHADOW:
+                case GL_INT_SAMPLER_2D:
+                case GL_INT_SAMPLER_3D:
+                case GL_INT_SAMPLER_CUBE:
+                case GL_INT_SAMPLER_2D_ARRAY:
+                case GL_UNSIGNED_INT_SAMPLER_2D:
+                case GL_UNSIGNED_INT_SAMPLER_3D:
+                case GL_UNSIGNED_INT_SAMPLER_CUBE:
+                case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    }
+    std::string Shader::readShaderFile(const std::string& fileName) {
 
         std::ifstream shaderFile;
         std::string shaderString;
@@ -58,7 +97,7 @@ namespace gps {
         }
     }
     
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
+    void Shader::loadShader(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName) {
 
         //read, parse and compile the vertex shader
         std::string v = readShaderFile(vertexShaderFileName);
@@ -81,7 +120,8 @@ namespace gps {
         shaderCompileLog(fragmentShader);
         
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
+        this->program = ProgramHandle::create();
+        this->shaderProgram = this->program.get();
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
         glLinkProgram(this->shaderProgram);
@@ -89,11 +129,95 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        assignSamplerUnits();
+        assignBlockBindings();
+    }
+
+    // Points each active sampler uniform at a unit of its own, so drawing never has to set them
+    void Shader::assignSamplerUnits() {
+
+        this->samplerUnits.clear();
+        this->samplerCount = 0;
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<GLchar> name(maxNameLength > 0 ? maxNameLength : 1);
+
+        GLint nextUnit = 0;
+        for (GLint i = 0; i < uniformCount; i++) {
+
+            GLint size = 0;
+            GLenum type = 0;
+            GLsizei length = 0;
+            glGetActiveUniform(this->shaderProgram, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            if (!IsSamplerType(type)) {
+                continue;
+            }
+
+            GLint location = glGetUniformLocation(this->shaderProgram, name.data());
+            std::vector<GLint> units(size);
+            for (GLint u = 0; u < size; u++) {
+                units[u] = nextUnit + u;
+            }
+            RenderState::current().useProgram(this->shaderProgram);
+            glUniform1iv(location, size, units.data());
+
+            //arrays are reported as name[0]
+            std::string uniformName(name.data(), length);
+            uniformName = uniformName.substr(0, uniformName.find('['));
+            this->samplerUnits[uniformName] = nextUnit;
+            nextUnit += size;
+        }
+        this->samplerCount = nextUnit;
+    }
+
+    // Binds each known uniform block to its shared binding point
+    void Shader::assignBlockBindings() {
+
+        GLint blockCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+        std::vector<GLchar> name(maxNameLength > 0 ? maxNameLength : 1);
+
+        for (GLint i = 0; i < blockCount; i++) {
+
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(this->shaderProgram, i, (GLsizei)name.size(), &length, name.data());
+            GLint binding = UniformBlockBindingFor(std::string(name.data(), length));
+            if (binding < 0) {
+                std::cout << "Uniform block " << name.data() << " has no shared binding point" << std::endl;
+                continue;
+            }
+            glUniformBlockBinding(this->shaderProgram, i, (GLuint)binding);
+        }
+    }
+
+    GLint Shader::samplerUnit(const std::string& name) const {
+
+        std::unordered_map<std::string, GLint>::const_iterator it = this->samplerUnits.find(name);
+        return it == this->samplerUnits.end() ? -1 : it->second;
+    }
+
+    GLint Shader::samplerUnitCount() const {
+
+        return this->samplerCount;
     }
     
-    void Shader::useShaderProgram() {
+    void Shader::useShaderProgram() const {
+
+        RenderState::current().useProgram(this->shaderProgram);
+    }
+
+    void Shader::deleteShaderProgram() {
 
-        glUseProgram(this->shaderProgram);
+        this->program.reset();
+        this->shaderProgram = 0;
+        this->samplerUnits.clear();
+        this->samplerCount = 0;
     }
 
 }
@@ -17,9 +17,13 @@
     #include <GL/glew.h>
 #endif
 
+#include "GLHandle.hpp"
+
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
 
 namespace gps {
@@ -28,13 +32,31 @@ namespace gps {
 
     public:
         GLuint shaderProgram;
-        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-        void useShaderProgram();
+        void loadShader(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+        void useShaderProgram() const;
+        // Deletes the program; call it before the GL context goes away
+        void deleteShaderProgram();
+
+        // Uniform blocks named in UniformBlocks.hpp are bound to their binding
+        // points at link time as well, so the shared buffers reach every program.
+
+        // Texture unit of a sampler uniform, -1 if the program has no such sampler.
+        // Every sampler gets its own unit once, at link time.
+        GLint samplerUnit(const std::string& name) const;
+        // Units 0 to samplerUnitCount() - 1 are the ones the program's samplers use
+        GLint samplerUnitCount() const;
     
     private:
-        std::string readShaderFile(std::string fileName);
+        //owns shaderProgram
+        ProgramHandle program;
+        std::unordered_map<std::string, GLint> samplerUnits;
+        GLint samplerCount = 0;
+
+        std::string readShaderFile(const std::string& fileName);
         void shaderCompileLog(GLuint shaderId);
         void shaderLinkLog(GLuint shaderProgramId);
+        void assignSamplerUnits();
+        void assignBlockBindings();
     };
     
 }
@@ -0,0 +1,163 @@
+#include "StreamBuffer.hpp"
+
+#include <chrono>
+#include <cstring>
+
+namespace gps {
+
+    StreamBuffer::StreamBuffer(size_t capacity)
+        : memory(NULL), capacity(capacity), position(0), fencedPosition(0), retiredPosition(0) {
+        counters.bytesWritten = 0;
+        counters.writes = 0;
+        counters.fenceWaits = 0;
+        counters.waitMicroseconds = 0;
+        counters.reallocations = 0;
+        counters.capacity = capacity;
+        counters.persistent = false;
+    }
+
+    bool StreamBuffer::isPersistentSupported() {
+#if defined (__APPLE__)
+        //macOS stops at GL 4.1
+        return false;
+#else
+        return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+    }
+
+    size_t StreamBuffer::write(const void* data, size_t size, size_t alignment) {
+        if (size > capacity) {
+            //everything written must be read before the buffer goes
+            fence();
+            waitFor(position);
+            capacity = size * 3 > capacity * 2 ? size * 3 : capacity * 2;
+            storage.reset();
+            counters.reallocations++;
+        }
+        if (!storage) {
+            createBuffer(capacity);
+        }
+
+        if (alignment < 1) {
+            alignment = 1;
+        }
+        size_t start = (position + alignment - 1) / alignment * alignment;
+        size_t offset = start % capacity;
+        if (offset + size > capacity) {
+            //does not fit before the end, start over at the beginning
+            start += capacity - offset;
+            offset = 0;
+        }
+        size_t end = start + size;
+        if (end > capacity) {
+            waitFor(end - capacity);
+        }
+
+        if (memory) {
+            std::memcpy(memory + offset, data, size);
+        } else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, storage.get());
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+        }
+
+        position = end;
+        counters.bytesWritten += size;
+        counters.writes++;
+        return offset;
+    }
+
+    void StreamBuffer::fence() {
+        if (!memory || fencedPosition == position) {
+            return;
+        }
+#if !defined (__APPLE__)
+        Fence fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), position };
+        fences.push_back(fence);
+        fencedPosition = position;
+#endif
+    }
+
+    GLuint StreamBuffer::buffer() const {
+        return storage.get();
+    }
+
+    StreamBufferStats StreamBuffer::stats() const {
+        return counters;
+    }
+
+    void StreamBuffer::releaseBuffers() {
+        deleteFences();
+#if !defined (__APPLE__)
+        if (memory) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, storage.get());
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+#endif
+        memory = NULL;
+        storage.reset();
+    }
+
+    void StreamBuffer::createBuffer(size_t bytes) {
+        deleteFences();
+        memory = NULL;
+        position = 0;
+        fencedPosition = 0;
+        retiredPosition = 0;
+
+        storage = BufferHandle::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, storage.get());
+        counters.persistent = isPersistentSupported();
+#if !defined (__APPLE__)
+        if (counters.persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)bytes, NULL, flags);
+            memory = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)bytes, flags);
+            counters.persistent = memory != NULL;
+        }
+#endif
+        if (!counters.persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_DRAW);
+        }
+        storage.setBytes(bytes);
+        counters.capacity = bytes;
+    }
+
+    void StreamBuffer::waitFor(size_t limit) {
+        if (!memory) {
+            return;
+        }
+        if (fencedPosition < limit) {
+            //the ring is smaller than what one frame writes, the CPU has to wait for it
+            fence();
+        }
+
+#if !defined (__APPLE__)
+        while (retiredPosition < limit && !fences.empty()) {
+            Fence& oldest = fences.front();
+            GLenum result = glClientWaitSync(oldest.sync, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED) {
+                counters.fenceWaits++;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                //one second at a time, flushing so the fence is sure to signal
+                do {
+                    result = glClientWaitSync(oldest.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                } while (result == GL_TIMEOUT_EXPIRED);
+                counters.waitMicroseconds += (size_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            }
+            glDeleteSync(oldest.sync);
+            retiredPosition = oldest.position;
+            fences.pop_front();
+        }
+#endif
+    }
+
+    void StreamBuffer::deleteFences() {
+#if !defined (__APPLE__)
+        for (size_t i = 0; i < fences.size(); i++) {
+            glDeleteSync(fences[i].sync);
+        }
+#endif
+        fences.clear();
+    }
+}
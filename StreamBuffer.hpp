@@ -0,0 +1,83 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <deque>
+
+namespace gps {
+
+    struct StreamBufferStats {
+        size_t bytesWritten;
+        size_t writes;
+        //times the ring caught up with data the GPU had not read yet
+        size_t fenceWaits;
+        size_t waitMicroseconds;
+        //grown because a single write did not fit
+        size_t reallocations;
+        size_t capacity;
+        bool persistent;
+    };
+
+    // Ring buffer for data rewritten every frame: uniforms, instance data,
+    // draw commands, dynamic geometry. Writes go to the next free bytes of one
+    // buffer, wrapping at the end. With GL 4.4 or ARB_buffer_storage the buffer
+    // is persistently mapped and written with memcpy; a fence placed after the
+    // draws reading each stretch keeps the ring from overwriting it too early.
+    // Elsewhere (always on macOS) writes use glBufferSubData, which GL keeps in
+    // order by itself.
+    //
+    // Size it for about three frames of data so fence waits stay at zero; the
+    // stats tell how often the CPU had to wait. GL thread only.
+    class StreamBuffer {
+
+    public:
+        explicit StreamBuffer(size_t capacity);
+
+        static bool isPersistentSupported();
+
+        // Copies size bytes to an offset that is a multiple of alignment. A write
+        // larger than the whole ring reallocates it, changing buffer().
+        size_t write(const void* data, size_t size, size_t alignment);
+
+        // Marks everything written so far as read by the draws issued so far;
+        // call after those draws, once per frame or batch
+        void fence();
+
+        GLuint buffer() const;
+
+        StreamBufferStats stats() const;
+
+        // Deletes the buffer and fences; the next write creates them again
+        void releaseBuffers();
+
+    private:
+        struct Fence {
+            GLsync sync;
+            //data written before this position is covered
+            size_t position;
+        };
+
+        BufferHandle storage;
+        unsigned char* memory;
+        size_t capacity;
+        //bytes written since creation, the offset in the buffer is position % capacity
+        size_t position;
+        size_t fencedPosition;
+        //data before this position has been read by the GPU
+        size_t retiredPosition;
+        std::deque<Fence> fences;
+        StreamBufferStats counters;
+
+        StreamBuffer(const StreamBuffer&);
+        StreamBuffer& operator=(const StreamBuffer&);
+
+        void createBuffer(size_t bytes);
+        // Waits until the GPU has read everything written before limit
+        void waitFor(size_t limit);
+        void deleteFences();
+    };
+}
+
+#endif /* StreamBuffer_hpp */
@@ -0,0 +1,124 @@
+#include "TextureCache.hpp"
+
+#include <cstdlib>
+#include <cctype>
+#include <utility>
+
+#if defined (_WIN32)
+    #include <stdlib.h>
+#else
+    #include <climits>
+#endif
+
+namespace gps {
+
+    TextureCache::TextureCache()
+        : hits(0), misses(0), bytesResident(0) {
+    }
+
+    TextureCache& TextureCache::shared() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    std::string TextureCache::canonicalPath(const std::string& path) {
+#if defined (_WIN32)
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH)) {
+            std::string canonical(resolved);
+            //the file system is case insensitive and accepts both separators
+            for (size_t i = 0; i < canonical.size(); i++) {
+                canonical[i] = canonical[i] == '\\' ? '/' : (char)tolower((unsigned char)canonical[i]);
+            }
+            return canonical;
+        }
+#else
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved)) {
+            return std::string(resolved);
+        }
+#endif
+        return path;
+    }
+
+    bool TextureCache::acquire(const std::string& canonicalPath, GLuint* id) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(canonicalPath);
+        if (it == entries.end()) {
+            misses++;
+            return false;
+        }
+
+        hits++;
+        it->second.references++;
+        *id = it->second.texture.get();
+        return true;
+    }
+
+    GLuint TextureCache::insert(const std::string& canonicalPath, TextureHandle texture) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(canonicalPath);
+        if (it != entries.end()) {
+            //another load got there first, keep a single copy in video memory; ours goes with the handle
+            it->second.references++;
+            return it->second.texture.get();
+        }
+
+        GLuint id = texture.get();
+        bytesResident += texture.getBytes();
+
+        Entry& entry = entries[canonicalPath];
+        entry.texture = std::move(texture);
+        entry.references = 1;
+
+        return id;
+    }
+
+    void TextureCache::release(const std::string& canonicalPath) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(canonicalPath);
+        if (it != entries.end() && it->second.references > 0) {
+            it->second.references--;
+        }
+    }
+
+    size_t TextureCache::evictUnused() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t evicted = 0;
+        std::unordered_map<std::string, Entry>::iterator it = entries.begin();
+        while (it != entries.end()) {
+            if (it->second.references == 0) {
+                bytesResident -= it->second.texture.getBytes();
+                it = entries.erase(it);
+                evicted++;
+            } else {
+                ++it;
+            }
+        }
+
+        return evicted;
+    }
+
+    void TextureCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        //the handles delete the textures
+        entries.clear();
+        bytesResident = 0;
+    }
+
+    TextureCacheStats TextureCache::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        TextureCacheStats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.texturesResident = entries.size();
+        stats.bytesResident = bytesResident;
+        return stats;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace gps {
+
+    struct TextureCacheStats {
+        size_t hits;
+        size_t misses;
+        size_t texturesResident;
+        size_t bytesResident;
+    };
+
+    // Process-wide cache of the textures loaded by every Model3D, keyed by the
+    // canonical path of the image file. Entries are reference counted; a texture
+    // nobody references stays resident until it is evicted explicitly.
+    //
+    // Lookups and bookkeeping are thread safe, so loader threads can skip
+    // decoding images that are already resident. Anything that deletes GL
+    // objects (evictUnused, clear, insert losing a race) must run on the thread
+    // owning the GL context.
+    class TextureCache {
+
+    public:
+        static TextureCache& shared();
+
+        // Absolute path with symbolic links and ./.. resolved, or the path itself
+        // if the file does not exist
+        static std::string canonicalPath(const std::string& path);
+
+        // Takes a reference to a resident texture; returns false on a miss
+        bool acquire(const std::string& canonicalPath, GLuint* id);
+
+        // Takes over a texture that was just uploaded after a miss, holding one
+        // reference; its size comes from texture.getBytes(). If another load
+        // uploaded the same file in the meantime that texture is kept, this one
+        // is deleted and the resident id is returned.
+        GLuint insert(const std::string& canonicalPath, TextureHandle texture);
+
+        // Drops a reference taken by acquire or insert
+        void release(const std::string& canonicalPath);
+
+        // Deletes the textures nobody references; returns how many were deleted
+        size_t evictUnused();
+
+        // Deletes every texture, referenced or not; call before the GL context goes away
+        void clear();
+
+        TextureCacheStats stats() const;
+
+    private:
+        struct Entry {
+            TextureHandle texture;
+            size_t references;
+        };
+
+        std::unordered_map<std::string, Entry> entries;
+        mutable std::mutex mutex;
+        size_t hits;
+        size_t misses;
+        size_t bytesResident;
+
+        TextureCache();
+        TextureCache(const TextureCache&);
+        TextureCache& operator=(const TextureCache&);
+    };
+}
+
+#endif /* TextureCache_hpp */
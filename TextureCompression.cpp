@@ -0,0 +1,810 @@
+#include "TextureCompression.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        // Gathers one 4x4 block, repeating the last row and column past the image edges
+        void FetchBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, unsigned char pixels[64]) {
+            for (int y = 0; y < 4; y++) {
+                int sourceY = std::min(blockY * 4 + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    int sourceX = std::min(blockX * 4 + x, width - 1);
+                    memcpy(pixels + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+                }
+            }
+        }
+
+        void StoreBlock(const unsigned char pixels[64], int width, int height, int blockX, int blockY, unsigned char* rgba) {
+            for (int y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                for (int x = 0; x < 4 && blockX * 4 + x < width; x++) {
+                    memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, pixels + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+
+        // Principal axis of the block's colors over `channels` channels, by power iteration
+        void PrincipalAxis(const unsigned char pixels[64], int channels, float mean[4], float axis[4]) {
+            float minimum[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+            float maximum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (int c = 0; c < 4; c++) {
+                mean[c] = 0.0f;
+                axis[c] = 0.0f;
+            }
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < channels; c++) {
+                    float v = pixels[i * 4 + c];
+                    mean[c] += v;
+                    minimum[c] = std::min(minimum[c], v);
+                    maximum[c] = std::max(maximum[c], v);
+                }
+            }
+
+            float covariance[4][4] = {};
+            for (int c = 0; c < channels; c++) {
+                mean[c] /= 16.0f;
+                axis[c] = maximum[c] - minimum[c];
+            }
+            for (int i = 0; i < 16; i++) {
+                for (int a = 0; a < channels; a++) {
+                    for (int b = 0; b < channels; b++) {
+                        covariance[a][b] += (pixels[i * 4 + a] - mean[a]) * (pixels[i * 4 + b] - mean[b]);
+                    }
+                }
+            }
+
+            for (int iteration = 0; iteration < 8; iteration++) {
+                float next[4] = {};
+                float length = 0.0f;
+                for (int a = 0; a < channels; a++) {
+                    for (int b = 0; b < channels; b++) {
+                        next[a] += covariance[a][b] * axis[b];
+                    }
+                    length += next[a] * next[a];
+                }
+                //flat block, keep the bounding box diagonal
+                if (length < 1e-12f) {
+                    break;
+                }
+                length = 1.0f / std::sqrt(length);
+                for (int c = 0; c < channels; c++) {
+                    axis[c] = next[c] * length;
+                }
+            }
+
+            float length = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                length += axis[c] * axis[c];
+            }
+            if (length > 0.0f) {
+                length = 1.0f / std::sqrt(length);
+                for (int c = 0; c < channels; c++) {
+                    axis[c] *= length;
+                }
+            }
+        }
+
+        // Endpoints at the extremes of the pixels' projection onto the axis, pulled in by `inset`
+        void AxisEndpoints(const unsigned char pixels[64], int channels, const float mean[4], const float axis[4],
+                           float inset, float first[4], float second[4]) {
+            float low = 0.0f;
+            float high = 0.0f;
+            for (int i = 0; i < 16; i++) {
+                float t = 0.0f;
+                for (int c = 0; c < channels; c++) {
+                    t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+                }
+                low = std::min(low, t);
+                high = std::max(high, t);
+            }
+
+            float shrink = (high - low) * inset;
+            low += shrink;
+            high -= shrink;
+
+            for (int c = 0; c < 4; c++) {
+                first[c] = mean[c] + axis[c] * high;
+                second[c] = mean[c] + axis[c] * low;
+            }
+        }
+
+        // Least squares endpoints for fixed per-pixel interpolation weights (weight of `second` in [0, 1])
+        bool FitEndpoints(const unsigned char pixels[64], int channels, const float weights[16], float first[4], float second[4]) {
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[4] = {}, bx[4] = {};
+
+            for (int i = 0; i < 16; i++) {
+                float b = weights[i];
+                float a = 1.0f - b;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < channels; c++) {
+                    ax[c] += a * pixels[i * 4 + c];
+                    bx[c] += b * pixels[i * 4 + c];
+                }
+            }
+
+            float determinant = aa * bb - ab * ab;
+            if (std::fabs(determinant) < 1e-6f) {
+                return false;
+            }
+
+            for (int c = 0; c < channels; c++) {
+                first[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                second[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+            }
+            return true;
+        }
+
+        // BC1
+
+        inline int Expand5(int v) { return (v << 3) | (v >> 2); }
+        inline int Expand6(int v) { return (v << 2) | (v >> 4); }
+
+        uint16_t Pack565(const float color[4]) {
+            int r = std::min(std::max((int)(color[0] * (31.0f / 255.0f) + 0.5f), 0), 31);
+            int g = std::min(std::max((int)(color[1] * (63.0f / 255.0f) + 0.5f), 0), 63);
+            int b = std::min(std::max((int)(color[2] * (31.0f / 255.0f) + 0.5f), 0), 31);
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        void BC1Palette(uint16_t c0, uint16_t c1, bool fourColors, int palette[4][4]) {
+            palette[0][0] = Expand5(c0 >> 11);
+            palette[0][1] = Expand6((c0 >> 5) & 63);
+            palette[0][2] = Expand5(c0 & 31);
+            palette[1][0] = Expand5(c1 >> 11);
+            palette[1][1] = Expand6((c1 >> 5) & 63);
+            palette[1][2] = Expand5(c1 & 31);
+            palette[0][3] = palette[1][3] = palette[2][3] = 255;
+
+            if (fourColors || c0 > c1) {
+                for (int c = 0; c < 3; c++) {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+                palette[3][3] = 255;
+            } else {
+                //three colors and transparent black
+                for (int c = 0; c < 3; c++) {
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                    palette[3][c] = 0;
+                }
+                palette[3][3] = 0;
+            }
+        }
+
+        // Orders the endpoints for four-color mode and picks the closest color per pixel; returns the error
+        int FitBC1(uint16_t& c0, uint16_t& c1, const unsigned char pixels[64], unsigned char indices[16]) {
+            if (c0 < c1) {
+                std::swap(c0, c1);
+            }
+
+            int palette[4][4];
+            BC1Palette(c0, c1, true, palette);
+            //with equal endpoints only the first entry is meaningful
+            int candidates = c0 == c1 ? 1 : 4;
+
+            int total = 0;
+            for (int i = 0; i < 16; i++) {
+                const unsigned char* p = pixels + i * 4;
+                int best = 0;
+                int bestError = 0x7FFFFFFF;
+                for (int k = 0; k < candidates; k++) {
+                    int dr = p[0] - palette[k][0];
+                    int dg = p[1] - palette[k][1];
+                    int db = p[2] - palette[k][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError) {
+                        bestError = error;
+                        best = k;
+                    }
+                }
+                indices[i] = (unsigned char)best;
+                total += bestError;
+            }
+            return total;
+        }
+
+        void EncodeBC1(const unsigned char pixels[64], unsigned char block[8]) {
+            float mean[4], axis[4], first[4], second[4];
+            PrincipalAxis(pixels, 3, mean, axis);
+            AxisEndpoints(pixels, 3, mean, axis, 1.0f / 16.0f, first, second);
+
+            uint16_t c0 = Pack565(first);
+            uint16_t c1 = Pack565(second);
+            unsigned char indices[16];
+            int error = FitBC1(c0, c1, pixels, indices);
+
+            //one least squares pass over the chosen indices
+            static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+            float weights[16];
+            for (int i = 0; i < 16; i++) {
+                weights[i] = WEIGHTS[indices[i]];
+            }
+            if (error > 0 && FitEndpoints(pixels, 3, weights, first, second)) {
+                uint16_t r0 = Pack565(first);
+                uint16_t r1 = Pack565(second);
+                unsigned char refined[16];
+                int refinedError = FitBC1(r0, r1, pixels, refined);
+                if (refinedError < error) {
+                    c0 = r0;
+                    c1 = r1;
+                    memcpy(indices, refined, 16);
+                }
+            }
+
+            uint32_t bits = 0;
+            for (int i = 0; i < 16; i++) {
+                bits |= (uint32_t)indices[i] << (2 * i);
+            }
+
+            block[0] = (unsigned char)c0;
+            block[1] = (unsigned char)(c0 >> 8);
+            block[2] = (unsigned char)c1;
+            block[3] = (unsigned char)(c1 >> 8);
+            for (int b = 0; b < 4; b++) {
+                block[4 + b] = (unsigned char)(bits >> (8 * b));
+            }
+        }
+
+        void DecodeBC1(const unsigned char block[8], bool fourColors, unsigned char pixels[64]) {
+            uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+            uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+            uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+            int palette[4][4];
+            BC1Palette(c0, c1, fourColors, palette);
+
+            for (int i = 0; i < 16; i++) {
+                const int* color = palette[(bits >> (2 * i)) & 3];
+                for (int c = 0; c < 4; c++) {
+                    pixels[i * 4 + c] = (unsigned char)color[c];
+                }
+            }
+        }
+
+        // BC4, one channel of a BC3 or BC5 block
+
+        void BC4Palette(int a0, int a1, int palette[8]) {
+            palette[0] = a0;
+            palette[1] = a1;
+            if (a0 > a1) {
+                for (int k = 2; k < 8; k++) {
+                    palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+                }
+            } else {
+                for (int k = 2; k < 6; k++) {
+                    palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+                }
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+        }
+
+        void EncodeBC4(const unsigned char pixels[64], int channel, unsigned char block[8]) {
+            int low = 255;
+            int high = 0;
+            for (int i = 0; i < 16; i++) {
+                low = std::min(low, (int)pixels[i * 4 + channel]);
+                high = std::max(high, (int)pixels[i * 4 + channel]);
+            }
+
+            int palette[8];
+            BC4Palette(high, low, palette);
+            int candidates = high == low ? 1 : 8;
+
+            uint64_t bits = 0;
+            for (int i = 0; i < 16; i++) {
+                int v = pixels[i * 4 + channel];
+                int best = 0;
+                for (int k = 1; k < candidates; k++) {
+                    if (std::abs(v - palette[k]) < std::abs(v - palette[best])) {
+                        best = k;
+                    }
+                }
+                bits |= (uint64_t)best << (3 * i);
+            }
+
+            block[0] = (unsigned char)high;
+            block[1] = (unsigned char)low;
+            for (int b = 0; b < 6; b++) {
+                block[2 + b] = (unsigned char)(bits >> (8 * b));
+            }
+        }
+
+        void DecodeBC4(const unsigned char block[8], int channel, unsigned char pixels[64]) {
+            int palette[8];
+            BC4Palette(block[0], block[1], palette);
+
+            uint64_t bits = 0;
+            for (int b = 0; b < 6; b++) {
+                bits |= (uint64_t)block[2 + b] << (8 * b);
+            }
+            for (int i = 0; i < 16; i++) {
+                pixels[i * 4 + channel] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+            }
+        }
+
+        // BC7
+
+        struct BitWriter {
+            unsigned char* block;
+            unsigned int position;
+
+            void write(unsigned int value, unsigned int count) {
+                for (unsigned int b = 0; b < count; b++, position++) {
+                    if ((value >> b) & 1) {
+                        block[position >> 3] |= (unsigned char)(1 << (position & 7));
+                    }
+                }
+            }
+        };
+
+        struct BitReader {
+            const unsigned char* block;
+            unsigned int position;
+
+            unsigned int read(unsigned int count) {
+                unsigned int value = 0;
+                for (unsigned int b = 0; b < count; b++, position++) {
+                    value |= (unsigned int)((block[position >> 3] >> (position & 7)) & 1) << b;
+                }
+                return value;
+            }
+        };
+
+        const int BC7_WEIGHTS2[4] = { 0, 21, 43, 64 };
+        const int BC7_WEIGHTS3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+        const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        inline int BC7Interpolate(int e0, int e1, int weight) {
+            return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+        }
+
+        const int* BC7Weights(int indexBits) {
+            return indexBits == 2 ? BC7_WEIGHTS2 : (indexBits == 3 ? BC7_WEIGHTS3 : BC7_WEIGHTS4);
+        }
+
+        struct BC7Mode {
+            int subsets;
+            int partitionBits;
+            int rotationBits;
+            int indexSelectionBits;
+            int colorBits;
+            int alphaBits;
+            int endpointPBits;
+            int sharedPBits;
+            int indexBits;
+            int secondaryIndexBits;
+        };
+
+        const BC7Mode BC7_MODES[8] = {
+            { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+            { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+            { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+            { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+            { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+            { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+            { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+            { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+        };
+
+        // Subset of each pixel, one bit per pixel
+        const uint16_t BC7_PARTITIONS2[64] = {
+            0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+            0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+            0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+            0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+            0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+            0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+            0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+            0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+        };
+
+        // Subset of each pixel, two bits per pixel
+        const uint32_t BC7_PARTITIONS3[64] = {
+            0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+            0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+            0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+            0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+            0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+            0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+            0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+            0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+        };
+
+        // Pixels whose index drops its top bit, beyond pixel 0
+        const unsigned char BC7_ANCHORS2[64] = {
+            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+            15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+            15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+             6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+        };
+
+        const unsigned char BC7_ANCHORS3_SECOND[64] = {
+             3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+             3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+             8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+             3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+        };
+
+        const unsigned char BC7_ANCHORS3_THIRD[64] = {
+            15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+            15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+            15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+            15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+        };
+
+        // Picks the closest of the 16 mode 6 palette entries per pixel; returns the error
+        int SelectMode6Indices(const unsigned char pixels[64], const int e0[4], const int e1[4], unsigned char indices[16]) {
+            int palette[16][4];
+            for (int k = 0; k < 16; k++) {
+                for (int c = 0; c < 4; c++) {
+                    palette[k][c] = BC7Interpolate(e0[c], e1[c], BC7_WEIGHTS4[k]);
+                }
+            }
+
+            int total = 0;
+            for (int i = 0; i < 16; i++) {
+                const unsigned char* p = pixels + i * 4;
+                int best = 0;
+                int bestError = 0x7FFFFFFF;
+                for (int k = 0; k < 16; k++) {
+                    int error = 0;
+                    for (int c = 0; c < 4; c++) {
+                        int d = p[c] - palette[k][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        best = k;
+                    }
+                }
+                indices[i] = (unsigned char)best;
+                total += bestError;
+            }
+            return total;
+        }
+
+        // Rounds an endpoint to 7 bits per channel plus the p-bit that fits it best
+        void QuantizeMode6Endpoint(const float color[4], int endpoint[4], int& pBit) {
+            float bestError = 1e30f;
+            for (int p = 0; p < 2; p++) {
+                int candidate[4];
+                float error = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    int q = std::min(std::max((int)std::floor((color[c] - p) * 0.5f + 0.5f), 0), 127);
+                    candidate[c] = (q << 1) | p;
+                    error += (candidate[c] - color[c]) * (candidate[c] - color[c]);
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    pBit = p;
+                    memcpy(endpoint, candidate, sizeof(candidate));
+                }
+            }
+        }
+
+        // Mode 6: one subset, 7.7.7.7 endpoints with a p-bit each and 4-bit indices
+        void EncodeBC7(const unsigned char pixels[64], unsigned char block[16]) {
+            float mean[4], axis[4], first[4], second[4];
+            PrincipalAxis(pixels, 4, mean, axis);
+            AxisEndpoints(pixels, 4, mean, axis, 0.0f, first, second);
+
+            int e0[4], e1[4], p0, p1;
+            QuantizeMode6Endpoint(first, e0, p0);
+            QuantizeMode6Endpoint(second, e1, p1);
+            unsigned char indices[16];
+            int error = SelectMode6Indices(pixels, e0, e1, indices);
+
+            float weights[16];
+            for (int i = 0; i < 16; i++) {
+                weights[i] = BC7_WEIGHTS4[indices[i]] / 64.0f;
+            }
+            if (error > 0 && FitEndpoints(pixels, 4, weights, first, second)) {
+                int r0[4], r1[4], q0, q1;
+                unsigned char refined[16];
+                QuantizeMode6Endpoint(first, r0, q0);
+                QuantizeMode6Endpoint(second, r1, q1);
+                int refinedError = SelectMode6Indices(pixels, r0, r1, refined);
+                if (refinedError < error) {
+                    memcpy(e0, r0, sizeof(e0));
+                    memcpy(e1, r1, sizeof(e1));
+                    p0 = q0;
+                    p1 = q1;
+                    memcpy(indices, refined, 16);
+                }
+            }
+
+            //the anchor pixel's index is stored without its top bit
+            if (indices[0] & 8) {
+                for (int c = 0; c < 4; c++) {
+                    std::swap(e0[c], e1[c]);
+                }
+                std::swap(p0, p1);
+                for (int i = 0; i < 16; i++) {
+                    indices[i] = (unsigned char)(15 - indices[i]);
+                }
+            }
+
+            memset(block, 0, 16);
+            BitWriter writer = { block, 0 };
+            writer.write(1 << 6, 7);
+            for (int c = 0; c < 4; c++) {
+                writer.write(e0[c] >> 1, 7);
+                writer.write(e1[c] >> 1, 7);
+            }
+            writer.write(p0, 1);
+            writer.write(p1, 1);
+            writer.write(indices[0], 3);
+            for (int i = 1; i < 16; i++) {
+                writer.write(indices[i], 4);
+            }
+        }
+
+        void DecodeBC7(const unsigned char block[16], unsigned char pixels[64]) {
+            int mode = 0;
+            while (mode < 8 && !((block[0] >> mode) & 1)) {
+                mode++;
+            }
+            //reserved mode, decodes to transparent black
+            if (mode == 8) {
+                memset(pixels, 0, 64);
+                return;
+            }
+
+            const BC7Mode& info = BC7_MODES[mode];
+            BitReader reader = { block, (unsigned int)mode + 1 };
+
+            int partition = reader.read(info.partitionBits);
+            int rotation = reader.read(info.rotationBits);
+            int indexSelection = reader.read(info.indexSelectionBits);
+
+            int endpoints[3][2][4];
+            for (int c = 0; c < 3; c++) {
+                for (int s = 0; s < info.subsets; s++) {
+                    endpoints[s][0][c] = reader.read(info.colorBits);
+                    endpoints[s][1][c] = reader.read(info.colorBits);
+                }
+            }
+            for (int s = 0; s < info.subsets; s++) {
+                endpoints[s][0][3] = reader.read(info.alphaBits);
+                endpoints[s][1][3] = reader.read(info.alphaBits);
+            }
+
+            int colorBits = info.colorBits;
+            int alphaBits = info.alphaBits;
+            if (info.endpointPBits || info.sharedPBits) {
+                int pBits[3][2];
+                for (int s = 0; s < info.subsets; s++) {
+                    if (info.endpointPBits) {
+                        pBits[s][0] = reader.read(1);
+                        pBits[s][1] = reader.read(1);
+                    } else {
+                        pBits[s][0] = pBits[s][1] = reader.read(1);
+                    }
+                }
+                for (int s = 0; s < info.subsets; s++) {
+                    for (int e = 0; e < 2; e++) {
+                        for (int c = 0; c < (alphaBits ? 4 : 3); c++) {
+                            endpoints[s][e][c] = (endpoints[s][e][c] << 1) | pBits[s][e];
+                        }
+                    }
+                }
+                colorBits++;
+                if (alphaBits) {
+                    alphaBits++;
+                }
+            }
+
+            //replicate the top bits down to 8 bits
+            for (int s = 0; s < info.subsets; s++) {
+                for (int e = 0; e < 2; e++) {
+                    for (int c = 0; c < 3; c++) {
+                        int v = endpoints[s][e][c] << (8 - colorBits);
+                        endpoints[s][e][c] = v | (v >> colorBits);
+                    }
+                    if (alphaBits) {
+                        int v = endpoints[s][e][3] << (8 - alphaBits);
+                        endpoints[s][e][3] = v | (v >> alphaBits);
+                    } else {
+                        endpoints[s][e][3] = 255;
+                    }
+                }
+            }
+
+            int subsetOf[16];
+            for (int i = 0; i < 16; i++) {
+                if (info.subsets == 2) {
+                    subsetOf[i] = (BC7_PARTITIONS2[partition] >> i) & 1;
+                } else if (info.subsets == 3) {
+                    subsetOf[i] = (BC7_PARTITIONS3[partition] >> (2 * i)) & 3;
+                } else {
+                    subsetOf[i] = 0;
+                }
+            }
+
+            int indices[16];
+            for (int i = 0; i < 16; i++) {
+                bool anchor = i == 0 ||
+                    (info.subsets == 2 && i == BC7_ANCHORS2[partition]) ||
+                    (info.subsets == 3 && (i == BC7_ANCHORS3_SECOND[partition] || i == BC7_ANCHORS3_THIRD[partition]));
+                indices[i] = reader.read(anchor ? info.indexBits - 1 : info.indexBits);
+            }
+
+            int secondary[16];
+            if (info.secondaryIndexBits) {
+                for (int i = 0; i < 16; i++) {
+                    secondary[i] = reader.read(i == 0 ? info.secondaryIndexBits - 1 : info.secondaryIndexBits);
+                }
+            }
+
+            for (int i = 0; i < 16; i++) {
+                const int (*e)[4] = endpoints[subsetOf[i]];
+                int colorIndex = indices[i];
+                int colorIndexBits = info.indexBits;
+                int alphaIndex = indices[i];
+                int alphaIndexBits = info.indexBits;
+
+                if (info.secondaryIndexBits) {
+                    if (indexSelection) {
+                        colorIndex = secondary[i];
+                        colorIndexBits = info.secondaryIndexBits;
+                    } else {
+                        alphaIndex = secondary[i];
+                        alphaIndexBits = info.secondaryIndexBits;
+                    }
+                }
+
+                unsigned char* p = pixels + i * 4;
+                for (int c = 0; c < 3; c++) {
+                    p[c] = (unsigned char)BC7Interpolate(e[0][c], e[1][c], BC7Weights(colorIndexBits)[colorIndex]);
+                }
+                p[3] = (unsigned char)BC7Interpolate(e[0][3], e[1][3], BC7Weights(alphaIndexBits)[alphaIndex]);
+
+                if (rotation) {
+                    std::swap(p[3], p[rotation - 1]);
+                }
+            }
+        }
+
+        void CompressBlockRows(const unsigned char* rgba, int width, int height, BlockFormat format,
+                               unsigned char* blocks, int firstRow, int lastRow) {
+            int blocksWide = (width + 3) / 4;
+            size_t bytes = BlockBytes(format);
+            unsigned char pixels[64];
+
+            for (int by = firstRow; by < lastRow; by++) {
+                for (int bx = 0; bx < blocksWide; bx++) {
+                    unsigned char* block = blocks + ((size_t)by * blocksWide + bx) * bytes;
+                    FetchBlock(rgba, width, height, bx, by, pixels);
+
+                    switch (format) {
+                    case BLOCK_BC1:
+                        EncodeBC1(pixels, block);
+                        break;
+                    case BLOCK_BC3:
+                        EncodeBC4(pixels, 3, block);
+                        EncodeBC1(pixels, block + 8);
+                        break;
+                    case BLOCK_BC5:
+                        EncodeBC4(pixels, 0, block);
+                        EncodeBC4(pixels, 1, block + 8);
+                        break;
+                    case BLOCK_BC7:
+                        EncodeBC7(pixels, block);
+                        break;
+                    case BLOCK_RGBA8:
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    const char* BlockFormatName(BlockFormat format) {
+        switch (format) {
+        case BLOCK_BC1: return "BC1";
+        case BLOCK_BC3: return "BC3";
+        case BLOCK_BC5: return "BC5";
+        case BLOCK_BC7: return "BC7";
+        case BLOCK_RGBA8: return "RGBA8";
+        }
+        return "?";
+    }
+
+    size_t BlockBytes(BlockFormat format) {
+        if (format == BLOCK_RGBA8) {
+            return 64;
+        }
+        return format == BLOCK_BC1 ? 8 : 16;
+    }
+
+    size_t CompressedImageSize(BlockFormat format, int width, int height) {
+        if (format == BLOCK_RGBA8) {
+            return (size_t)width * height * 4;
+        }
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+    }
+
+    void CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+                       unsigned char* blocks, ThreadPool* workers) {
+        if (format == BLOCK_RGBA8) {
+            memcpy(blocks, rgba, CompressedImageSize(format, width, height));
+            return;
+        }
+
+        int blocksHigh = (height + 3) / 4;
+
+        if (!workers || workers->size() < 2 || blocksHigh < 2) {
+            CompressBlockRows(rgba, width, height, format, blocks, 0, blocksHigh);
+            return;
+        }
+
+        //a few strips per worker so uneven blocks balance out
+        int strips = std::min(blocksHigh, (int)workers->size() * 4);
+        std::vector<std::future<void> > done;
+        for (int s = 0; s < strips; s++) {
+            int firstRow = blocksHigh * s / strips;
+            int lastRow = blocksHigh * (s + 1) / strips;
+            done.push_back(workers->submit([=]() { CompressBlockRows(rgba, width, height, format, blocks, firstRow, lastRow); }));
+        }
+        for (size_t s = 0; s < done.size(); s++) {
+            done[s].get();
+        }
+    }
+
+    void DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format,
+                         unsigned char* rgba) {
+        if (format == BLOCK_RGBA8) {
+            memcpy(rgba, blocks, CompressedImageSize(format, width, height));
+            return;
+        }
+
+        int blocksWide = (width + 3) / 4;
+        int blocksHigh = (height + 3) / 4;
+        size_t bytes = BlockBytes(format);
+        unsigned char pixels[64];
+
+        for (int by = 0; by < blocksHigh; by++) {
+            for (int bx = 0; bx < blocksWide; bx++) {
+                const unsigned char* block = blocks + ((size_t)by * blocksWide + bx) * bytes;
+
+                switch (format) {
+                case BLOCK_BC1:
+                    DecodeBC1(block, false, pixels);
+                    break;
+                case BLOCK_BC3:
+                    DecodeBC1(block + 8, true, pixels);
+                    DecodeBC4(block, 3, pixels);
+                    break;
+                case BLOCK_BC5:
+                    for (int i = 0; i < 16; i++) {
+                        pixels[i * 4 + 2] = 0;
+                        pixels[i * 4 + 3] = 255;
+                    }
+                    DecodeBC4(block, 0, pixels);
+                    DecodeBC4(block + 8, 1, pixels);
+                    break;
+                case BLOCK_BC7:
+                    DecodeBC7(block, pixels);
+                    break;
+                case BLOCK_RGBA8:
+                    break;
+                }
+
+                StoreBlock(pixels, width, height, bx, by, rgba);
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef TextureCompression_hpp
+#define TextureCompression_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    class ThreadPool;
+
+    // Block compressed formats, each storing 4x4 pixel blocks, plus plain
+    // RGBA8 so uncompressed mip chains share the same containers
+    enum BlockFormat {
+        BLOCK_BC1,  //RGB, 8 bytes per block
+        BLOCK_BC3,  //RGBA, BC1 color plus a BC4 alpha block, 16 bytes
+        BLOCK_BC5,  //RG, two BC4 blocks, 16 bytes (normal maps)
+        BLOCK_BC7,  //RGBA, 16 bytes
+        BLOCK_RGBA8 //uncompressed, 4 bytes per pixel
+    };
+
+    const char* BlockFormatName(BlockFormat format);
+
+    // Bytes of one 4x4 block
+    size_t BlockBytes(BlockFormat format);
+
+    // Bytes of one image, partial blocks on the right and bottom edges rounded up
+    size_t CompressedImageSize(BlockFormat format, int width, int height);
+
+    // Compresses an RGBA8 image; edge blocks repeat the last row / column.
+    // BC7 blocks are encoded in mode 6 only. Rows of blocks are split over
+    // `workers` when given.
+    void CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+                       unsigned char* blocks, ThreadPool* workers = NULL);
+
+    // Expands a compressed image back to RGBA8. Every BC7 mode is decoded, so
+    // textures made by other tools can be checked too. BC5 expands to (R, G, 0, 255).
+    void DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format,
+                         unsigned char* rgba);
+}
+
+#endif /* TextureCompression_hpp */
@@ -0,0 +1,415 @@
+#include "TextureFile.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    namespace {
+
+        struct DdsPixelFormat {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t fourCC;
+            uint32_t rgbBitCount;
+            uint32_t redMask;
+            uint32_t greenMask;
+            uint32_t blueMask;
+            uint32_t alphaMask;
+        };
+
+        struct DdsHeader {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t height;
+            uint32_t width;
+            uint32_t pitchOrLinearSize;
+            uint32_t depth;
+            uint32_t mipMapCount;
+            uint32_t reserved1[11];
+            DdsPixelFormat pixelFormat;
+            uint32_t caps;
+            uint32_t caps2;
+            uint32_t caps3;
+            uint32_t caps4;
+            uint32_t reserved2;
+        };
+
+        struct DdsHeaderDx10 {
+            uint32_t dxgiFormat;
+            uint32_t resourceDimension;
+            uint32_t miscFlag;
+            uint32_t arraySize;
+            uint32_t miscFlags2;
+        };
+
+        static_assert(sizeof(DdsHeader) == 124, "DDS header layout");
+        static_assert(sizeof(DdsHeaderDx10) == 20, "DDS DX10 header layout");
+
+        const uint32_t DDS_MAGIC = 0x20534444; //"DDS "
+
+        const uint32_t DDSD_CAPS = 0x1;
+        const uint32_t DDSD_HEIGHT = 0x2;
+        const uint32_t DDSD_WIDTH = 0x4;
+        const uint32_t DDSD_PITCH = 0x8;
+        const uint32_t DDSD_PIXELFORMAT = 0x1000;
+        const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+        const uint32_t DDSD_LINEARSIZE = 0x80000;
+        const uint32_t DDPF_FOURCC = 0x4;
+        const uint32_t DDSCAPS_COMPLEX = 0x8;
+        const uint32_t DDSCAPS_TEXTURE = 0x1000;
+        const uint32_t DDSCAPS_MIPMAP = 0x400000;
+        const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+        const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM = 28;
+        const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29;
+        const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+        const uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+        const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+        const uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+        const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+        const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+        const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+        inline uint32_t FourCC(char a, char b, char c, char d) {
+            return (uint32_t)(unsigned char)a | ((uint32_t)(unsigned char)b << 8) |
+                   ((uint32_t)(unsigned char)c << 16) | ((uint32_t)(unsigned char)d << 24);
+        }
+
+        const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+        struct Ktx2Header {
+            unsigned char identifier[12];
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+
+        struct Ktx2Level {
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        static_assert(sizeof(Ktx2Header) == 80, "KTX2 header layout");
+
+        bool FormatFromDxgi(uint32_t dxgiFormat, BlockFormat& format, bool& srgb) {
+            switch (dxgiFormat) {
+            case DXGI_FORMAT_R8G8B8A8_UNORM: format = BLOCK_RGBA8; srgb = false; return true;
+            case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: format = BLOCK_RGBA8; srgb = true; return true;
+            case DXGI_FORMAT_BC1_UNORM: format = BLOCK_BC1; srgb = false; return true;
+            case DXGI_FORMAT_BC1_UNORM_SRGB: format = BLOCK_BC1; srgb = true; return true;
+            case DXGI_FORMAT_BC3_UNORM: format = BLOCK_BC3; srgb = false; return true;
+            case DXGI_FORMAT_BC3_UNORM_SRGB: format = BLOCK_BC3; srgb = true; return true;
+            case DXGI_FORMAT_BC5_UNORM: format = BLOCK_BC5; srgb = false; return true;
+            case DXGI_FORMAT_BC7_UNORM: format = BLOCK_BC7; srgb = false; return true;
+            case DXGI_FORMAT_BC7_UNORM_SRGB: format = BLOCK_BC7; srgb = true; return true;
+            }
+            return false;
+        }
+
+        uint32_t DxgiFromFormat(BlockFormat format, bool srgb) {
+            switch (format) {
+            case BLOCK_BC1: return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+            case BLOCK_BC3: return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+            case BLOCK_BC5: return DXGI_FORMAT_BC5_UNORM;
+            case BLOCK_BC7: return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+            case BLOCK_RGBA8: return srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+            }
+            return 0;
+        }
+
+        bool FormatFromVulkan(uint32_t vkFormat, BlockFormat& format, bool& srgb) {
+            switch (vkFormat) {
+            case 37: format = BLOCK_RGBA8; srgb = false; return true;
+            case 43: format = BLOCK_RGBA8; srgb = true; return true;
+            case 131: case 133: format = BLOCK_BC1; srgb = false; return true;
+            case 132: case 134: format = BLOCK_BC1; srgb = true; return true;
+            case 137: format = BLOCK_BC3; srgb = false; return true;
+            case 138: format = BLOCK_BC3; srgb = true; return true;
+            case 141: format = BLOCK_BC5; srgb = false; return true;
+            case 145: format = BLOCK_BC7; srgb = false; return true;
+            case 146: format = BLOCK_BC7; srgb = true; return true;
+            }
+            return false;
+        }
+
+        bool HasExtension(const std::string& fileName, const char* extension) {
+            size_t length = strlen(extension);
+            if (fileName.size() < length) {
+                return false;
+            }
+            for (size_t i = 0; i < length; i++) {
+                if (tolower((unsigned char)fileName[fileName.size() - length + i]) != extension[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    void AllocateLevels(BlockFormat format, bool srgb, int width, int height, CompressedTexture& texture) {
+        texture.format = format;
+        texture.srgb = srgb;
+        texture.levels.clear();
+        memset(texture.userData, 0, sizeof(texture.userData));
+
+        size_t offset = 0;
+        while (true) {
+            TextureLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.size = CompressedImageSize(format, width, height);
+            texture.levels.push_back(level);
+            offset += level.size;
+
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+
+        texture.data.assign(offset, 0);
+    }
+
+    bool ReadDDS(const std::string& fileName, CompressedTexture& texture) {
+        MappedFile file;
+        if (!file.open(fileName)) {
+            return false;
+        }
+
+        const unsigned char* base = (const unsigned char*)file.data();
+        uint64_t size = file.size();
+        uint64_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+
+        uint32_t magic;
+        DdsHeader header;
+        if (size < offset) {
+            return false;
+        }
+        memcpy(&magic, base, sizeof(magic));
+        memcpy(&header, base + sizeof(magic), sizeof(header));
+        if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || header.width == 0 || header.height == 0) {
+            return false;
+        }
+
+        BlockFormat format;
+        bool srgb;
+        if (!(header.pixelFormat.flags & DDPF_FOURCC)) {
+            return false;
+        }
+        if (header.pixelFormat.fourCC == FourCC('D', 'X', '1', '0')) {
+            DdsHeaderDx10 extension;
+            if (size < offset + sizeof(extension)) {
+                return false;
+            }
+            memcpy(&extension, base + offset, sizeof(extension));
+            offset += sizeof(extension);
+
+            if (extension.resourceDimension != DDS_DIMENSION_TEXTURE2D || extension.arraySize > 1 ||
+                !FormatFromDxgi(extension.dxgiFormat, format, srgb)) {
+                return false;
+            }
+        } else if (header.pixelFormat.fourCC == FourCC('D', 'X', 'T', '1')) {
+            //the old header has no color space; model textures are color data
+            format = BLOCK_BC1;
+            srgb = true;
+        } else if (header.pixelFormat.fourCC == FourCC('D', 'X', 'T', '5')) {
+            format = BLOCK_BC3;
+            srgb = true;
+        } else if (header.pixelFormat.fourCC == FourCC('A', 'T', 'I', '2') ||
+                   header.pixelFormat.fourCC == FourCC('B', 'C', '5', 'U')) {
+            format = BLOCK_BC5;
+            srgb = false;
+        } else {
+            return false;
+        }
+
+        uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mipMapCount, 1u) : 1;
+
+        texture.format = format;
+        texture.srgb = srgb;
+        texture.levels.clear();
+        memcpy(texture.userData, header.reserved1, sizeof(texture.userData));
+
+        int width = (int)header.width;
+        int height = (int)header.height;
+        size_t dataSize = 0;
+        for (uint32_t i = 0; i < levelCount; i++) {
+            TextureLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = dataSize;
+            level.size = CompressedImageSize(format, width, height);
+            texture.levels.push_back(level);
+            dataSize += level.size;
+
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+
+        if (size - offset < dataSize) {
+            return false;
+        }
+
+        texture.data.assign(base + offset, base + offset + dataSize);
+        return true;
+    }
+
+    bool WriteDDS(const std::string& fileName, const CompressedTexture& texture) {
+        if (texture.levels.empty()) {
+            return false;
+        }
+
+        DdsHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DdsHeader);
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+        header.height = (uint32_t)texture.levels[0].height;
+        header.width = (uint32_t)texture.levels[0].width;
+        if (texture.format == BLOCK_RGBA8) {
+            header.flags |= DDSD_PITCH;
+            header.pitchOrLinearSize = (uint32_t)texture.levels[0].width * 4;
+        } else {
+            header.flags |= DDSD_LINEARSIZE;
+            header.pitchOrLinearSize = (uint32_t)texture.levels[0].size;
+        }
+        header.mipMapCount = (uint32_t)texture.levels.size();
+        memcpy(header.reserved1, texture.userData, sizeof(texture.userData));
+        header.pixelFormat.size = sizeof(DdsPixelFormat);
+        header.pixelFormat.flags = DDPF_FOURCC;
+        header.pixelFormat.fourCC = FourCC('D', 'X', '1', '0');
+        header.caps = DDSCAPS_TEXTURE | (texture.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+        DdsHeaderDx10 extension;
+        memset(&extension, 0, sizeof(extension));
+        extension.dxgiFormat = DxgiFromFormat(texture.format, texture.srgb);
+        extension.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        extension.arraySize = 1;
+
+        // Write next to the final name and rename, like the mesh cache
+        std::string temporaryName = fileName + ".tmp";
+        std::ofstream out(temporaryName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        out.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)&extension, sizeof(extension));
+        for (size_t i = 0; i < texture.levels.size(); i++) {
+            out.write((const char*)texture.data.data() + texture.levels[i].offset, (std::streamsize)texture.levels[i].size);
+        }
+
+        out.close();
+        if (!out) {
+            std::remove(temporaryName.c_str());
+            return false;
+        }
+
+        std::remove(fileName.c_str());
+        return std::rename(temporaryName.c_str(), fileName.c_str()) == 0;
+    }
+
+    bool ReadKTX2(const std::string& fileName, CompressedTexture& texture) {
+        MappedFile file;
+        if (!file.open(fileName)) {
+            return false;
+        }
+
+        const unsigned char* base = (const unsigned char*)file.data();
+        uint64_t size = file.size();
+
+        Ktx2Header header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, base, sizeof(header));
+
+        BlockFormat format;
+        bool srgb;
+        if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+            header.supercompressionScheme != 0 ||
+            header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 ||
+            header.layerCount > 1 || header.faceCount != 1 ||
+            !FormatFromVulkan(header.vkFormat, format, srgb)) {
+            return false;
+        }
+
+        uint32_t levelCount = std::max(header.levelCount, 1u);
+        if (size < sizeof(header) + (uint64_t)levelCount * sizeof(Ktx2Level)) {
+            return false;
+        }
+
+        texture.format = format;
+        texture.srgb = srgb;
+        texture.levels.clear();
+        texture.data.clear();
+        memset(texture.userData, 0, sizeof(texture.userData));
+
+        // The level index starts with the base level; the data is stored smallest first
+        int width = (int)header.pixelWidth;
+        int height = (int)header.pixelHeight;
+        for (uint32_t i = 0; i < levelCount; i++) {
+            Ktx2Level entry;
+            memcpy(&entry, base + sizeof(header) + i * sizeof(Ktx2Level), sizeof(entry));
+
+            TextureLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = texture.data.size();
+            level.size = CompressedImageSize(format, width, height);
+
+            if (entry.byteLength != level.size || entry.byteOffset > size || size - entry.byteOffset < entry.byteLength) {
+                return false;
+            }
+
+            texture.data.insert(texture.data.end(), base + entry.byteOffset, base + entry.byteOffset + entry.byteLength);
+            texture.levels.push_back(level);
+
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+
+        return true;
+    }
+
+    std::string CompressedTextureFileName(const std::string& imageFileName) {
+        size_t dot = imageFileName.find_last_of('.');
+        size_t slash = imageFileName.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return imageFileName + ".dds";
+        }
+        return imageFileName.substr(0, dot) + ".dds";
+    }
+
+    bool IsCompressedTextureFile(const std::string& fileName) {
+        return HasExtension(fileName, ".dds") || HasExtension(fileName, ".ktx2");
+    }
+
+    bool ReadCompressedTexture(const std::string& fileName, CompressedTexture& texture) {
+        if (HasExtension(fileName, ".ktx2")) {
+            return ReadKTX2(fileName, texture);
+        }
+        return ReadDDS(fileName, texture);
+    }
+}
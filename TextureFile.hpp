@@ -0,0 +1,51 @@
+#ifndef TextureFile_hpp
+#define TextureFile_hpp
+
+#include "TextureCompression.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct TextureLevel {
+        int width;
+        int height;
+        //byte range inside CompressedTexture::data
+        size_t offset;
+        size_t size;
+    };
+
+    // A block compressed (or RGBA8) 2D texture with its mip chain, first row at the top
+    struct CompressedTexture {
+        BlockFormat format;
+        bool srgb;
+        std::vector<TextureLevel> levels;
+        std::vector<unsigned char> data;
+        //free words for the writer, kept in the reserved space of the DDS header
+        uint32_t userData[8];
+    };
+
+    // DDS with the DX10 extension header; legacy DXT1 / DXT5 / ATI2 files are read too
+    bool ReadDDS(const std::string& fileName, CompressedTexture& texture);
+
+    bool WriteDDS(const std::string& fileName, const CompressedTexture& texture);
+
+    // KTX2 without supercompression
+    bool ReadKTX2(const std::string& fileName, CompressedTexture& texture);
+
+    // Compressed file preferred over an image: the same name with a .dds extension
+    std::string CompressedTextureFileName(const std::string& imageFileName);
+
+    // True for the .dds and .ktx2 extensions
+    bool IsCompressedTextureFile(const std::string& fileName);
+
+    // Picks the reader from the file extension
+    bool ReadCompressedTexture(const std::string& fileName, CompressedTexture& texture);
+
+    // Lays out the levels of a width x height texture, halving down to 1x1
+    void AllocateLevels(BlockFormat format, bool srgb, int width, int height, CompressedTexture& texture);
+}
+
+#endif /* TextureFile_hpp */
@@ -0,0 +1,71 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned int threadCount)
+        : stopping(false) {
+
+        threadCount = resolveThreadCount(threadCount);
+
+        workers.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        shutdown();
+    }
+
+    void ThreadPool::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    unsigned int ThreadPool::size() const {
+        return (unsigned int)workers.size();
+    }
+
+    unsigned int ThreadPool::resolveThreadCount(unsigned int threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        //hardware_concurrency() may report 0 when it cannot tell
+        return threadCount > 0 ? threadCount : 1;
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        taskAvailable.notify_one();
+    }
+
+    void ThreadPool::workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    //stopping and nothing left to do
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+}
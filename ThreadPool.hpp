@@ -0,0 +1,63 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace gps {
+
+    // Fixed-size pool of worker threads consuming a FIFO task queue.
+    // shutdown() or the destructor finishes the queued tasks and joins the workers.
+    class ThreadPool {
+
+    public:
+        //threadCount = 0 uses one thread per hardware thread
+        explicit ThreadPool(unsigned int threadCount = 0);
+        ~ThreadPool();
+
+        unsigned int size() const;
+
+        //finishes the queued tasks and joins the workers; tasks submitted
+        //afterwards never run. Call it before anything the tasks use goes away
+        //rather than relying on the order static objects are destroyed in
+        void shutdown();
+
+        //queues a task; the future reports its result or rethrows its exception
+        template <typename Task>
+        std::future<typename std::result_of<Task()>::type> submit(Task task) {
+            typedef typename std::result_of<Task()>::type Result;
+
+            std::shared_ptr<std::packaged_task<Result()> > packaged =
+                std::make_shared<std::packaged_task<Result()> >(std::move(task));
+            std::future<Result> result = packaged->get_future();
+
+            enqueue([packaged]() { (*packaged)(); });
+            return result;
+        }
+
+        //resolves a requested thread count, 0 meaning "all hardware threads"
+        static unsigned int resolveThreadCount(unsigned int threadCount);
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > tasks;
+        std::mutex mutex;
+        std::condition_variable taskAvailable;
+        bool stopping;
+
+        void enqueue(std::function<void()> task);
+        void workerLoop();
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+}
+
+#endif /* ThreadPool_hpp */
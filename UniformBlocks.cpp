@@ -0,0 +1,104 @@
+#include "UniformBlocks.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace gps {
+
+    namespace {
+
+        // Three frames of 1024 object blocks each, with 256 byte alignment
+        const size_t UNIFORM_STREAM_CAPACITY = 3 * 1024 * 256;
+    }
+
+    GLint UniformBlockBindingFor(const std::string& name) {
+        if (name == "FrameUniforms") {
+            return FRAME_UNIFORMS_BINDING;
+        }
+        if (name == "ObjectUniforms") {
+            return OBJECT_UNIFORMS_BINDING;
+        }
+        return -1;
+    }
+
+    UniformBlocks::UniformBlocks()
+        : stream(UNIFORM_STREAM_CAPACITY), alignment(0), objectsWritten(0), decodeBound(false) {
+        frameData.view = glm::mat4(1.0f);
+        frameData.projection = glm::mat4(1.0f);
+        frameData.viewProjection = glm::mat4(1.0f);
+        frameData.lightDir = glm::vec4(0.0f);
+        frameData.lightColor = glm::vec4(0.0f);
+        frameData.lightDirEye = glm::vec4(0.0f);
+        frameData.time = 0.0f;
+        object.model = glm::mat4(1.0f);
+        object.normalMatrix = glm::mat4(1.0f);
+    }
+
+    UniformBlocks& UniformBlocks::shared() {
+        static UniformBlocks blocks;
+        return blocks;
+    }
+
+    void UniformBlocks::beginFrame(const FrameUniforms& frame) {
+        frameData = frame;
+        bindBlock(FRAME_UNIFORMS_BINDING, &frameData, sizeof(FrameUniforms));
+    }
+
+    void UniformBlocks::endFrame() {
+        stream.fence();
+    }
+
+    const FrameUniforms& UniformBlocks::frame() const {
+        return frameData;
+    }
+
+    ObjectUniforms UniformBlocks::objectUniforms(const glm::mat4& model) const {
+        ObjectUniforms object;
+        object.model = model;
+        object.normalMatrix = glm::mat4(glm::mat3(glm::inverseTranspose(frameData.view * model)));
+        return object;
+    }
+
+    void UniformBlocks::setObject(const ObjectUniforms& object) {
+        this->object = object;
+        bindBlock(OBJECT_UNIFORMS_BINDING, &object, sizeof(ObjectUniforms));
+        decodeBound = false;
+        objectsWritten++;
+    }
+
+    void UniformBlocks::applyPositionDecode(const glm::mat4* decode) {
+        if (decode) {
+            ObjectUniforms decoded = object;
+            decoded.model = object.model * *decode;
+            bindBlock(OBJECT_UNIFORMS_BINDING, &decoded, sizeof(ObjectUniforms));
+            decodeBound = true;
+            objectsWritten++;
+        } else if (decodeBound) {
+            //written again rather than rebound, the ring may have moved past the old copy
+            ObjectUniforms plain = object;
+            setObject(plain);
+        }
+    }
+
+    UniformBlockStats UniformBlocks::stats() const {
+        UniformBlockStats stats;
+        stats.objectsWritten = objectsWritten;
+        stats.stream = stream.stats();
+        return stats;
+    }
+
+    void UniformBlocks::releaseBuffers() {
+        stream.releaseBuffers();
+    }
+
+    void UniformBlocks::bindBlock(GLuint binding, const void* data, size_t size) {
+        if (alignment == 0) {
+            //bound ranges must start at a multiple of it
+            GLint offsetAlignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+            alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 1;
+        }
+
+        size_t offset = stream.write(data, size, alignment);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.buffer(), (GLintptr)offset, (GLsizeiptr)size);
+    }
+}
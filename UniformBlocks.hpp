@@ -0,0 +1,105 @@
+#ifndef UniformBlocks_hpp
+#define UniformBlocks_hpp
+
+#include "GLHandle.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+namespace gps {
+
+    // Binding points of the uniform blocks every shader may declare. GLSL 4.10
+    // cannot name them in the shader, so Shader::loadShader binds blocks by name.
+    enum UniformBlockBinding {
+        FRAME_UNIFORMS_BINDING = 0,     //uniform FrameUniforms
+        OBJECT_UNIFORMS_BINDING = 1     //uniform ObjectUniforms
+    };
+
+    // Binding point of a block declared as `uniform <name>`, -1 for unknown blocks
+    GLint UniformBlockBindingFor(const std::string& name);
+
+    // std140 layout of FrameUniforms in the shaders
+    struct FrameUniforms {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 viewProjection;
+        //direction towards the light in world space, w unused
+        glm::vec4 lightDir;
+        glm::vec4 lightColor;
+        //normalize(view * lightDir), so fragments do not recompute it
+        glm::vec4 lightDirEye;
+        //seconds since start
+        float time;
+        float padding[3];
+    };
+
+    // std140 layout of ObjectUniforms in the shaders
+    struct ObjectUniforms {
+        glm::mat4 model;
+        //mat3 in the upper left; std140 pads mat3 columns to vec4 anyway
+        glm::mat4 normalMatrix;
+    };
+
+    struct UniformBlockStats {
+        size_t objectsWritten;
+        //the ring both blocks are written to
+        StreamBufferStats stream;
+    };
+
+    // Buffers behind the shared uniform blocks. The frame block is written once
+    // per frame and stays bound, so every program sees the same view, projection
+    // and light without per-program uniform calls. Object blocks are written per
+    // draw and bound by range. Both go through one StreamBuffer, persistently
+    // mapped where GL allows it.
+    //
+    // GL thread only; call releaseBuffers() before the GL context goes away.
+    class UniformBlocks {
+
+    public:
+        static UniformBlocks& shared();
+
+        // Writes and binds the frame block
+        void beginFrame(const FrameUniforms& frame);
+        // Fences the blocks written during the frame
+        void endFrame();
+
+        const FrameUniforms& frame() const;
+
+        // Object block of a model matrix, with the normal matrix for the current view
+        ObjectUniforms objectUniforms(const glm::mat4& model) const;
+
+        // Writes an object block and binds it for the next draws
+        void setObject(const ObjectUniforms& object);
+
+        // Binds the last object block with its model matrix followed by a mesh's
+        // position decode (see Mesh::getPositionDecode), or the block unchanged
+        // for NULL; nothing is written while the unchanged block is bound.
+        void applyPositionDecode(const glm::mat4* decode);
+
+        UniformBlockStats stats() const;
+
+        void releaseBuffers();
+
+    private:
+        FrameUniforms frameData;
+        StreamBuffer stream;
+        //GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, 0 until queried
+        size_t alignment;
+        size_t objectsWritten;
+        //the last setObject() block
+        ObjectUniforms object;
+        //a decoded variant of it is bound instead
+        bool decodeBound;
+
+        UniformBlocks();
+        UniformBlocks(const UniformBlocks&);
+        UniformBlocks& operator=(const UniformBlocks&);
+
+        // Writes a block and binds its range to a binding point
+        void bindBlock(GLuint binding, const void* data, size_t size);
+    };
+}
+
+#endif /* UniformBlocks_hpp */
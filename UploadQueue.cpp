@@ -0,0 +1,62 @@
+#include "UploadQueue.hpp"
+
+namespace gps {
+
+    UploadQueue::UploadQueue(size_t capacity)
+        : capacity(capacity > 0 ? capacity : 1) {
+    }
+
+    void UploadQueue::push(std::function<void()> upload) {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceAvailable.wait(lock, [this]() { return uploads.size() < capacity; });
+        uploads.push_back(std::move(upload));
+    }
+
+    bool UploadQueue::pop(std::function<void()>& upload) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (uploads.empty()) {
+                return false;
+            }
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+        spaceAvailable.notify_one();
+        return true;
+    }
+
+    size_t UploadQueue::drain(std::chrono::microseconds budget) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t executed = 0;
+
+        std::function<void()> upload;
+        while (pop(upload)) {
+            upload();
+            executed++;
+
+            if (std::chrono::steady_clock::now() - start >= budget) {
+                break;
+            }
+        }
+
+        return executed;
+    }
+
+    size_t UploadQueue::drainAll() {
+        size_t count = pending();
+        size_t executed = 0;
+
+        std::function<void()> upload;
+        while (executed < count && pop(upload)) {
+            upload();
+            executed++;
+        }
+
+        return executed;
+    }
+
+    size_t UploadQueue::pending() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return uploads.size();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef UploadQueue_hpp
+#define UploadQueue_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace gps {
+
+    // Bounded FIFO of GL work produced by loader threads and executed on the
+    // thread that owns the GL context. Producers block while the queue is full,
+    // so decoded data waiting for upload cannot pile up without limit.
+    class UploadQueue {
+
+    public:
+        explicit UploadQueue(size_t capacity = 64);
+
+        //any thread; blocks while the queue is full. Never call it from the
+        //draining thread, that thread is the only one that can make room
+        void push(std::function<void()> upload);
+
+        //GL thread; runs queued uploads until the queue is empty or the budget
+        //is spent. At least one upload runs per call, so progress is guaranteed
+        //even if a single upload is larger than the budget. Returns the number run
+        size_t drain(std::chrono::microseconds budget);
+
+        //GL thread; runs everything queued at the time of the call
+        size_t drainAll();
+
+        size_t pending() const;
+
+    private:
+        std::deque<std::function<void()> > uploads;
+        size_t capacity;
+        mutable std::mutex mutex;
+        std::condition_variable spaceAvailable;
+
+        bool pop(std::function<void()>& upload);
+    };
+}
+
+#endif /* UploadQueue_hpp */
@@ -0,0 +1,185 @@
+#include "VertexQuantization.hpp"
+#include "Mesh.hpp"
+#include "Bounds.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        int32_t SignExtend10(uint32_t bits) {
+            return (int32_t)(bits << 22) >> 22;
+        }
+    }
+
+    VertexFormat QuantizedVertexFormat() {
+        VertexFormat format;
+        format.stride = sizeof(QuantizedVertex);
+
+        VertexAttribute position = { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position) };
+        VertexAttribute normal = { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, normal) };
+        VertexAttribute texCoords = { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, texCoords) };
+        format.attributes.push_back(position);
+        format.attributes.push_back(normal);
+        format.attributes.push_back(texCoords);
+        return format;
+    }
+
+    void QuantizeVertices(const Vertex* vertices, size_t count, QuantizedMesh& quantized) {
+        quantized.vertices.resize(count);
+        QuantizationError& error = quantized.error;
+        error.position = 0.0f;
+        error.positionRelative = 0.0f;
+        error.normalDegrees = 0.0f;
+        error.texCoords = 0.0f;
+
+        BoundingBox box = ComputeBox(vertices, count);
+        if (IsEmpty(box)) {
+            box.min = box.max = glm::vec3(0.0f);
+        }
+        const glm::vec3& boundsMin = box.min;
+        glm::vec3 extent = box.max - box.min;
+        //flat sides decode to a single value, any scale will do
+        glm::vec3 scale(extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f);
+        quantized.decode = glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), scale);
+
+        float maxNormalCos = 1.0f;
+        for (size_t i = 0; i < count; i++) {
+            const Vertex& vertex = vertices[i];
+            QuantizedVertex& encoded = quantized.vertices[i];
+
+            glm::vec3 decoded;
+            for (int c = 0; c < 3; c++) {
+                float unit = (vertex.Position[c] - boundsMin[c]) / scale[c];
+                uint16_t value = (uint16_t)std::min(65535.0f, std::max(0.0f, std::floor(unit * 65535.0f + 0.5f)));
+                encoded.position[c] = value;
+                decoded[c] = boundsMin[c] + value / 65535.0f * scale[c];
+            }
+            encoded.padding = 0;
+            error.position = std::max(error.position, glm::length(decoded - vertex.Position));
+
+            glm::vec3 normal = vertex.Normal;
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normal /= length;
+                encoded.normal = PackSnorm10(normal);
+                glm::vec3 unpacked = glm::normalize(UnpackSnorm10(encoded.normal));
+                maxNormalCos = std::min(maxNormalCos, glm::dot(normal, unpacked));
+            } else {
+                encoded.normal = 0;
+            }
+
+            for (int c = 0; c < 2; c++) {
+                encoded.texCoords[c] = FloatToHalf(vertex.TexCoords[c]);
+                error.texCoords = std::max(error.texCoords, std::fabs(HalfToFloat(encoded.texCoords[c]) - vertex.TexCoords[c]));
+            }
+        }
+
+        float largestSide = std::max(extent.x, std::max(extent.y, extent.z));
+        error.positionRelative = largestSide > 0.0f ? error.position / largestSide : 0.0f;
+        error.normalDegrees = glm::degrees(std::acos(std::min(1.0f, std::max(-1.0f, maxNormalCos))));
+    }
+
+    void ReportQuantization(const std::string& meshName, const QuantizedMesh& quantized) {
+        const QuantizationError& error = quantized.error;
+        std::cout << "Quantized      : " << (meshName.empty() ? "(unnamed)" : meshName) << " "
+                  << quantized.vertices.size() << " vertices, " << sizeof(QuantizedVertex) << " instead of " << sizeof(Vertex)
+                  << " bytes each; max error position " << error.position << " (" << error.positionRelative * 100.0f
+                  << "% of the bounds), normal " << error.normalDegrees << " deg, uv " << error.texCoords << std::endl;
+    }
+
+    uint16_t FloatToHalf(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        int32_t exponent = (int32_t)((bits >> 23) & 0xFFu) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+
+        if (((bits >> 23) & 0xFFu) == 0xFFu) {
+            //infinity stays infinity, NaN stays NaN
+            return (uint16_t)(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+        }
+        if (exponent >= 31) {
+            return (uint16_t)(sign | 0x7C00u);
+        }
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return (uint16_t)sign;
+            }
+            //subnormal half, round to nearest even
+            mantissa |= 0x800000u;
+            uint32_t shift = (uint32_t)(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            uint32_t halfway = 1u << (shift - 1u);
+            if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+                half++;
+            }
+            return (uint16_t)(sign | half);
+        }
+
+        uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1FFFu;
+        //a carry into the exponent is still the right rounding
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+            half++;
+        }
+        return (uint16_t)half;
+    }
+
+    float HalfToFloat(uint16_t half) {
+        uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+        uint32_t exponent = (half >> 10) & 0x1Fu;
+        uint32_t mantissa = half & 0x3FFu;
+
+        uint32_t bits;
+        if (exponent == 0) {
+            if (mantissa == 0) {
+                bits = sign;
+            } else {
+                //subnormal, normalize it
+                int32_t e = -1;
+                do {
+                    e++;
+                    mantissa <<= 1;
+                } while ((mantissa & 0x400u) == 0);
+                bits = sign | ((uint32_t)(127 - 15 - e) << 23) | ((mantissa & 0x3FFu) << 13);
+            }
+        } else if (exponent == 31) {
+            bits = sign | 0x7F800000u | (mantissa << 13);
+        } else {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint32_t PackSnorm10(const glm::vec3& value) {
+        uint32_t packed = 0;
+        for (int c = 0; c < 3; c++) {
+            float clamped = std::min(1.0f, std::max(-1.0f, value[c]));
+            int32_t component = (int32_t)std::floor(clamped * 511.0f + 0.5f);
+            packed |= ((uint32_t)component & 0x3FFu) << (10 * c);
+        }
+        return packed;
+    }
+
+    glm::vec3 UnpackSnorm10(uint32_t packed) {
+        //GL 4.2 and later; 4.1 decodes (2c + 1) / 1023, at most 1/1023 away
+        glm::vec3 value;
+        for (int c = 0; c < 3; c++) {
+            value[c] = std::max(-1.0f, SignExtend10((packed >> (10 * c)) & 0x3FFu) / 511.0f);
+        }
+        return value;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef VertexQuantization_hpp
+#define VertexQuantization_hpp
+
+#include "GeometryArena.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // How a mesh's vertices are stored in video memory
+    enum VertexEncoding {
+        VERTEX_FLOAT,       //gps::Vertex, 32 bytes
+        VERTEX_QUANTIZED    //gps::QuantizedVertex, 16 bytes
+    };
+
+    // 16 byte vertex. The shaders read it through the same vec3/vec3/vec2
+    // attributes as gps::Vertex, GL converts the normalized integers and halfs:
+    //  - position: 16-bit unsigned normalized, relative to the mesh bounds; the
+    //    mesh's decode matrix, folded into the model matrix, maps it back
+    //  - normal: signed normalized GL_INT_2_10_10_10_REV
+    //  - texture coordinates: half floats
+    struct QuantizedVertex {
+        uint16_t position[3];
+        uint16_t padding;
+        uint32_t normal;
+        uint16_t texCoords[2];
+    };
+
+    // Largest differences between the original and the decoded vertices
+    struct QuantizationError {
+        //model units
+        float position;
+        //position error over the largest side of the bounds
+        float positionRelative;
+        float normalDegrees;
+        float texCoords;
+    };
+
+    struct QuantizedMesh {
+        std::vector<QuantizedVertex> vertices;
+        //maps the [0, 1] positions the shader reads back to model space
+        glm::mat4 decode;
+        QuantizationError error;
+    };
+
+    // Layout of gps::QuantizedVertex at locations 0, 1 and 2
+    VertexFormat QuantizedVertexFormat();
+
+    // Encodes the vertices and measures what the encoding lost
+    void QuantizeVertices(const Vertex* vertices, size_t count, QuantizedMesh& quantized);
+
+    // One line per mesh, for the load log
+    void ReportQuantization(const std::string& meshName, const QuantizedMesh& quantized);
+
+    uint16_t FloatToHalf(float value);
+    float HalfToFloat(uint16_t half);
+
+    // GL_INT_2_10_10_10_REV with the components of a unit vector in x, y and z
+    uint32_t PackSnorm10(const glm::vec3& value);
+    glm::vec3 UnpackSnorm10(uint32_t packed);
+}
+
+#endif /* VertexQuantization_hpp */
@@ -17,8 +17,17 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
-
+#include "TextureCache.hpp"
+#include "RenderState.hpp"
+#include "GLHandle.hpp"
+#include "GeometryArena.hpp"
+#include "IndirectRenderer.hpp"
+#include "InstanceBuffer.hpp"
+#include "UniformBlocks.hpp"
+
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 // window
 gps::Window myWindow;
@@ -27,20 +36,13 @@ gps::Window myWindow;
 glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
+// vertical field of view, also used to pick levels of detail
+const float fieldOfView = glm::radians(45.0f);
 
 // light parameters
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-
 // camera
 gps::Camera myCamera(
     glm::vec3(0.0f, 0.0f, 3.0f),
@@ -55,8 +57,24 @@ GLboolean pressedKeys[1024];
 gps::Model3D teapot;
 GLfloat angle;
 
+// asset streaming: cleanup() finishes the loads and joins the loader threads before teardown
+gps::UploadQueue uploadQueue;
+gps::ThreadPool loaderThreads(2);
+gps::ModelLoadHandle teapotLoad;
+bool teapotLoadChecked = false;
+// time per frame the render thread may spend on GPU uploads
+const std::chrono::microseconds uploadBudget(4000);
+
 // shaders
 gps::Shader myBasicShader;
+// GL 4.3 only, left empty otherwise
+gps::Shader myIndirectShader;
+
+// one glMultiDrawElementsIndirect per batch where GL 4.3 is available, the model loop elsewhere
+gps::IndirectRenderer sceneRenderer;
+
+// frames rendered, to average the GL call counters over
+unsigned long frameCount = 0;
 
 GLenum glCheckError_(const char *file, int line)
 {
@@ -114,56 +132,36 @@ void processMovement() {
 		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
 		//update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_S]) {
 		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
     if (pressedKeys[GLFW_KEY_Q]) {
         angle -= 1.0f;
         // update model matrix for teapot
         model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
 
     if (pressedKeys[GLFW_KEY_E]) {
         angle += 1.0f;
         // update model matrix for teapot
         model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
 }
 
@@ -189,78 +187,150 @@ void initOpenGLState() {
 }
 
 void initModels() {
-    teapot.LoadModel("models/teapot/teapot20segUT.obj");
+    // parsing and texture decoding run on the loader threads, the uploads are drained every frame
+    teapotLoad = teapot.LoadModelAsync("models/teapot/teapot20segUT.obj", gps::ModelLoadOptions(), loaderThreads, uploadQueue);
+}
+
+// Reports a failed load once its outcome is known
+void checkModelLoads() {
+    if (teapotLoadChecked || !teapotLoad.isReady()) {
+        return;
+    }
+    teapotLoadChecked = true;
+    try {
+        teapotLoad.get();
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+}
+
+// Runs the remaining uploads until the load is done; the loader threads only
+// finish once the queue has made room for everything they push
+void finishModelLoads() {
+    while (teapotLoad.isValid() && !teapotLoad.isReady()) {
+        if (uploadQueue.drainAll() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    checkModelLoads();
 }
 
 void initShaders() {
 	myBasicShader.loadShader(
         "shaders/basic.vert",
         "shaders/basic.frag");
+    if (gps::IndirectRenderer::isSupported()) {
+        myIndirectShader.loadShader(
+            "shaders/indirect.vert",
+            "shaders/basic.frag");
+    }
 }
 
 void initUniforms() {
-	myBasicShader.useShaderProgram();
-
     // create model matrix for teapot
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-    // compute normal matrix for teapot
-    normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
-	projection = glm::perspective(glm::radians(45.0f),
+	projection = glm::perspective(fieldOfView,
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
                                0.1f, 20.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 }
 
-void renderTeapot(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+// Uploads the per-frame uniform block, read by every program
+void updateFrameUniforms() {
+    gps::FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewProjection = projection * view;
+    frame.lightDir = glm::vec4(lightDir, 0.0f);
+    frame.lightColor = glm::vec4(lightColor, 1.0f);
+    // once per frame on the CPU rather than per fragment
+    frame.lightDirEye = glm::vec4(glm::normalize(glm::vec3(view * glm::vec4(lightDir, 0.0f))), 0.0f);
+    frame.time = (float)glfwGetTime();
+    gps::UniformBlocks::shared().beginFrame(frame);
+}
 
-    // draw teapot
-    teapot.Draw(shader);
+void renderTeapot(const gps::Shader& shader) {
+    // the renderer writes the object block of whichever shader it draws with
+    sceneRenderer.submit(teapot, model,
+                         gps::LodSelectionFor(myCamera, fieldOfView, (float)myWindow.getWindowDimensions().height));
+    sceneRenderer.flush(myIndirectShader, shader);
 }
 
 void renderScene() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    updateFrameUniforms();
 
 	//render the scene
 
 	// render the teapot
 	renderTeapot(myBasicShader);
 
+    gps::UniformBlocks::shared().endFrame();
+}
+
+void printArenaStats(const char* label, const gps::GeometryArenaStats& stats) {
+    std::cout << label << stats.ranges << " mesh(es), " << stats.verticesUsed << "/" << stats.vertexCapacity
+              << " vertices, " << stats.indicesUsed << "/" << stats.indexCapacity << " indices" << std::endl;
+}
+
+// Fence waits tell whether a stream holds enough frames of data
+void printStreamStats(const char* label, const gps::StreamBufferStats& stats) {
+    std::cout << label << stats.bytesWritten / 1024 << " KB in " << stats.writes << " write(s), "
+              << stats.fenceWaits << " fence wait(s) (" << stats.waitMicroseconds << " us), "
+              << stats.capacity / 1024 << " KB" << (stats.persistent ? " persistently mapped" : "");
+    if (stats.reallocations > 0) {
+        std::cout << ", grown " << stats.reallocations << " time(s)";
+    }
+    std::cout << std::endl;
 }
 
 void cleanup() {
+    //no loader thread may still touch the model, the texture cache or the queue;
+    //the pool is joined here, the function-local TextureCache may be destroyed before it
+    finishModelLoads();
+    loaderThreads.shutdown();
+
+    gps::RenderStateStats renderStats = gps::RenderState::current().stats();
+    unsigned long frames = frameCount > 0 ? frameCount : 1;
+    printArenaStats("Geometry arena : ", gps::GeometryArena::shared().stats());
+    printArenaStats("Quantized arena: ", gps::GeometryArena::quantized().stats());
+    gps::IndirectRendererStats sceneStats = sceneRenderer.stats();
+    std::cout << "Scene renderer : " << sceneStats.draws << " draw(s) in " << sceneStats.batches
+              << (sceneStats.indirect ? " indirect batch(es)" : " loop draw(s)") << ", "
+              << sceneStats.triangles << " triangle(s)" << std::endl;
+    std::cout << "Meshlets       : " << sceneStats.meshlets.tested << " tested, " << sceneStats.meshlets.frustumCulled
+              << " outside the frustum, " << sceneStats.meshlets.backfaceCulled << " back-facing" << std::endl;
+    gps::UniformBlockStats blockStats = gps::UniformBlocks::shared().stats();
+    std::cout << "Object blocks  : " << blockStats.objectsWritten / frames << "/frame" << std::endl;
+    printStreamStats("Uniform stream : ", blockStats.stream);
+    printStreamStats("Instance stream: ", gps::InstanceBuffer::shared().stats());
+    printStreamStats("Indirect stream: ", sceneRenderer.streamStats());
+    std::cout << "GL calls/frame : " << renderStats.callsIssued / frames << " issued, "
+              << renderStats.callsSkipped / frames << " skipped, " << renderStats.drawCalls / frames << " draw(s)" << std::endl;
+    gps::TextureCacheStats textureStats = gps::TextureCache::shared().stats();
+    std::cout << "Texture cache  : " << textureStats.hits << " hit(s), " << textureStats.misses << " miss(es), "
+              << textureStats.texturesResident << " resident (" << textureStats.bytesResident / (1024 * 1024) << " MB)" << std::endl;
+    //everything owning GL objects must go before the context does
+    teapot.Unload();
+    myBasicShader.deleteShaderProgram();
+    myIndirectShader.deleteShaderProgram();
+    sceneRenderer.releaseBuffers();
+    gps::InstanceBuffer::shared().releaseBuffers();
+    gps::UniformBlocks::shared().releaseBuffers();
+    gps::TextureCache::shared().clear();
+    gps::GeometryArena::shared().releaseBuffers();
+    gps::GeometryArena::quantized().releaseBuffers();
+    gps::GLObjectTracker::shared().report(std::cout);
     myWindow.Delete();
     //cleanup code for your own data
 }
@@ -283,8 +353,11 @@ int main(int argc, const char * argv[]) {
 	glCheckError();
 	// application loop
 	while (!glfwWindowShouldClose(myWindow.getWindow())) {
+        uploadQueue.drain(uploadBudget);
+        checkModelLoads();
         processMovement();
 	    renderScene();
+        frameCount++;
 
 		glfwPollEvents();
 		glfwSwapBuffers(myWindow.getWindow());
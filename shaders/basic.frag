@@ -1,18 +1,24 @@
 #version 410 core
 
-in vec3 fPosition;
-in vec3 fNormal;
+in vec3 fPosEye;
+in vec3 fNormalEye;
 in vec2 fTexCoords;
 
 out vec4 fColor;
 
-//matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
-//lighting
-uniform vec3 lightDir;
-uniform vec3 lightColor;
+//shared by every program, see UniformBlocks.hpp
+layout(std140) uniform FrameUniforms {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	//towards the light, world space
+	vec4 lightDir;
+	vec4 lightColor;
+	//towards the light, eye space and normalized, from the CPU
+	vec4 lightDirEye;
+	float time;
+};
+
 // textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
@@ -26,26 +32,23 @@ float specularStrength = 0.5f;
 
 void computeDirLight()
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
-
-    //normalize light direction
-    vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
+    //eye space position and normal come from the vertex shader, the light direction from the CPU
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 lightDirN = lightDirEye.xyz;
 
     //compute view direction (in eye coordinates, the viewer is situated at the origin
-    vec3 viewDir = normalize(- fPosEye.xyz);
+    vec3 viewDir = normalize(- fPosEye);
 
     //compute ambient light
-    ambient = ambientStrength * lightColor;
+    ambient = ambientStrength * lightColor.rgb;
 
     //compute diffuse light
-    diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+    diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor.rgb;
 
     //compute specular light
     vec3 reflectDir = reflect(-lightDirN, normalEye);
     float specCoeff = pow(max(dot(viewDir, reflectDir), 0.0f), 32);
-    specular = specularStrength * specCoeff * lightColor;
+    specular = specularStrength * specCoeff * lightColor.rgb;
 }
 
 void main() 
@@ -4,18 +4,35 @@ layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
-out vec3 fPosition;
-out vec3 fNormal;
+out vec3 fPosEye;
+out vec3 fNormalEye;
 out vec2 fTexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+//shared by every program, see UniformBlocks.hpp
+layout(std140) uniform FrameUniforms {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	//towards the light, world space
+	vec4 lightDir;
+	vec4 lightColor;
+	//towards the light, eye space and normalized, from the CPU
+	vec4 lightDirEye;
+	float time;
+};
+
+layout(std140) uniform ObjectUniforms {
+	mat4 model;
+	//upper left mat3
+	mat4 normalMatrix;
+};
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	vec4 posEye = view * model * vec4(vPosition, 1.0f);
+	gl_Position = projection * posEye;
+	//eye space, once per vertex instead of once per fragment
+	fPosEye = posEye.xyz;
+	fNormalEye = mat3(normalMatrix) * vNormal;
 	fTexCoords = vTexCoords;
 }
@@ -0,0 +1,44 @@
+#version 430 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//index of the draw, from the command's baseInstance
+layout(location=3) in uint vDrawId;
+
+struct DrawTransform {
+	mat4 model;
+	//for the current view, upper left mat3
+	mat4 normalMatrix;
+};
+
+layout(std430, binding=0) readonly buffer DrawTransforms {
+	DrawTransform transforms[];
+};
+
+out vec3 fPosEye;
+out vec3 fNormalEye;
+out vec2 fTexCoords;
+
+//shared by every program, see UniformBlocks.hpp
+layout(std140) uniform FrameUniforms {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	//towards the light, world space
+	vec4 lightDir;
+	vec4 lightColor;
+	//towards the light, eye space and normalized, from the CPU
+	vec4 lightDirEye;
+	float time;
+};
+
+void main() 
+{
+	DrawTransform t = transforms[vDrawId];
+	vec4 posEye = view * t.model * vec4(vPosition, 1.0f);
+	gl_Position = projection * posEye;
+	fPosEye = posEye.xyz;
+	fNormalEye = mat3(t.normalMatrix) * vNormal;
+	fTexCoords = vTexCoords;
+}
@@ -0,0 +1,45 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//model matrix of the instance, one column per location 3 to 6
+layout(location=3) in mat4 instanceModel;
+
+out vec3 fPosEye;
+out vec3 fNormalEye;
+out vec2 fTexCoords;
+
+//shared by every program, see UniformBlocks.hpp
+layout(std140) uniform FrameUniforms {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	//towards the light, world space
+	vec4 lightDir;
+	vec4 lightColor;
+	//towards the light, eye space and normalized, from the CPU
+	vec4 lightDirEye;
+	float time;
+};
+
+//position decode of quantized meshes, the identity for the others
+layout(std140) uniform ObjectUniforms {
+	mat4 model;
+	mat4 normalMatrix;
+};
+
+void main() 
+{
+	mat4 modelView = view * instanceModel;
+	vec4 posEye = modelView * model * vec4(vPosition, 1.0f);
+	gl_Position = projection * posEye;
+	fPosEye = posEye.xyz;
+
+	//cofactor matrix: the inverse transpose times the determinant, which basic.frag
+	//normalizes away; mirroring matrices (negative determinant) are not supported
+	mat3 m = mat3(modelView);
+	mat3 normalMatrix = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+	fNormalEye = normalMatrix * vNormal;
+	fTexCoords = vTexCoords;
+}
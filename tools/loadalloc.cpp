@@ -0,0 +1,158 @@
+// loadalloc: loads a model and checks that its geometry is never copied on the
+// way from the .obj parser to video memory. Every operator new made during the
+// load is recorded; afterwards no allocation may have the exact size of a
+// mesh's vertex array, and the only one the size of its index array is the
+// reserve ReadOBJ makes before parsing. A copy of either array would add one.
+//
+//   loadalloc [file.obj]
+//
+// The load runs on one thread, without the mesh cache, the mesh optimizer,
+// levels of detail, meshlets or mip precomputation, all of which build
+// geometry or image arrays of their own. Exits with a failure status when a
+// copy is found.
+//
+// Build from the repository root (a hidden window provides the GL context):
+//   g++ -std=c++14 -O2 -I. tools/loadalloc.cpp $(ls *.cpp | grep -v '^main.cpp$')
+//       -lglfw -lGLEW -lGL -lpthread -o loadalloc
+
+#include "Model3D.hpp"
+#include "GeometryArena.hpp"
+#include "TextureCache.hpp"
+#include "UniformBlocks.hpp"
+#include "InstanceBuffer.hpp"
+#include "GLHandle.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+
+namespace {
+
+    // Sizes of the allocations made while tracking; a plain array, since
+    // recording must not allocate itself
+    const size_t MAX_RECORDED = 1 << 20;
+    size_t recordedSizes[MAX_RECORDED];
+    size_t recordedCount = 0;
+    bool tracking = false;
+
+    bool IsPowerOfTwo(size_t value) {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+}
+
+void* operator new(size_t size) {
+    if (tracking && recordedCount < MAX_RECORDED) {
+        recordedSizes[recordedCount++] = size;
+    }
+    void* memory = malloc(size > 0 ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+int main(int argc, const char* argv[]) {
+    std::string fileName = argc > 1 ? argv[1] : "models/teapot/teapot20segUT.obj";
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: could not start GLFW\n");
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "loadalloc", NULL, NULL);
+    if (!window) {
+        fprintf(stderr, "ERROR: could not create a GL context\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+#if !defined (__APPLE__)
+    glewExperimental = GL_TRUE;
+    glewInit();
+#endif
+
+    gps::ModelLoadOptions options;
+    options.threadCount = 1;
+    options.useMeshCache = false;
+    options.optimizeMeshes = false;
+    options.generateLods = false;
+    options.buildMeshlets = false;
+    options.precomputeMipmaps = false;
+    options.useCompressedTextures = false;
+
+    bool ok = true;
+    {
+        gps::Model3D model;
+        tracking = true;
+        model.LoadModel(fileName, options);
+        tracking = false;
+
+        std::map<size_t, size_t> seen;
+        for (size_t i = 0; i < recordedCount; i++) {
+            seen[recordedSizes[i]]++;
+        }
+
+        // What the parser itself allocates at each size: the index reserve, and
+        // a vertex array grown by push_back that may land on the exact size when
+        // the count is a power of two
+        std::map<size_t, size_t> expected;
+        const std::vector<gps::Mesh>& meshes = model.getMeshes();
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const gps::GeometryRange& geometry = meshes[m].getGeometry();
+            expected[(size_t)geometry.indexCount() * sizeof(GLuint)]++;
+            expected[geometry.vertexCount() * sizeof(gps::Vertex)] += IsPowerOfTwo(geometry.vertexCount()) ? 1 : 0;
+        }
+
+        std::cout << "Allocations    : " << recordedCount << " during the load of " << meshes.size() << " mesh(es)" << std::endl;
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const gps::GeometryRange& geometry = meshes[m].getGeometry();
+            size_t vertexBytes = geometry.vertexCount() * sizeof(gps::Vertex);
+            size_t indexBytes = (size_t)geometry.indexCount() * sizeof(GLuint);
+            std::cout << "Mesh           : " << meshes[m].name << " " << seen[vertexBytes] << " vertex-sized (" << vertexBytes
+                      << " bytes), " << seen[indexBytes] << " index-sized (" << indexBytes << " bytes)" << std::endl;
+        }
+
+        for (std::map<size_t, size_t>::const_iterator it = expected.begin(); it != expected.end(); ++it) {
+            if (it->first > 0 && seen[it->first] > it->second) {
+                std::cout << "FAILED         : " << seen[it->first] - it->second << " extra allocation(s) of "
+                          << it->first << " bytes, the geometry was copied" << std::endl;
+                ok = false;
+            }
+        }
+        if (meshes.empty()) {
+            std::cout << "FAILED         : no mesh loaded from " << fileName << std::endl;
+            ok = false;
+        }
+
+        model.Unload();
+    }
+
+    gps::UniformBlocks::shared().releaseBuffers();
+    gps::InstanceBuffer::shared().releaseBuffers();
+    gps::TextureCache::shared().clear();
+    gps::GeometryArena::shared().releaseBuffers();
+    gps::GeometryArena::quantized().releaseBuffers();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    if (ok) {
+        std::cout << "OK             : no vertex or index array copied" << std::endl;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
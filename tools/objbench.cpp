@@ -0,0 +1,220 @@
+// objbench: compares the memory-mapped .obj parser with tinyobj::LoadObj. Each
+// file is parsed by both, the results are checked to be identical and the
+// best throughput of several runs is reported in MB/s.
+//
+//   objbench [-n runs] [-j threads] [--synthetic MB] [file.obj]...
+//
+// Without files it parses models/teapot/teapot20segUT.obj and a synthetic
+// file of the given size (15 MB by default) with relative face indices,
+// groups and material switches, written to objbench_synthetic.obj in the
+// working directory and removed afterwards. -j is the thread count of
+// gps::LoadObjMapped (1 by default, 0 = all hardware threads).
+//
+// Build from the repository root:
+//   g++ -std=c++14 -O2 -I. tools/objbench.cpp ObjParser.cpp MappedFile.cpp ThreadPool.cpp
+//       tiny_obj_loader.cpp -lpthread -o objbench
+
+#include "ObjParser.hpp"
+#include "ThreadPool.hpp"
+
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    const char* SYNTHETIC_FILE = "objbench_synthetic.obj";
+
+    struct ObjResult {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        bool loaded;
+    };
+
+    std::string BasePath(const std::string& fileName) {
+        size_t slash = fileName.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+    }
+
+    size_t FileBytes(const std::string& fileName) {
+        std::ifstream in(fileName.c_str(), std::ios::binary | std::ios::ate);
+        return in ? (size_t)in.tellg() : 0;
+    }
+
+    // A grid of quads, one vertex, texcoord and normal per corner, faces
+    // referencing them relatively, with a group and material switch now and then
+    bool WriteSyntheticObj(const char* fileName, size_t megabytes) {
+        std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        const size_t targetBytes = megabytes * 1024 * 1024;
+        char line[160];
+        size_t written = 0;
+        for (unsigned int quad = 0; written < targetBytes; quad++) {
+            if (quad % 50000 == 0) {
+                int length = snprintf(line, sizeof(line), "g part%u\nusemtl material%u\n", quad / 50000, quad / 50000 % 4);
+                out.write(line, length);
+                written += (size_t)length;
+            }
+
+            float x = (float)(quad % 1024) * 0.01f;
+            float z = (float)(quad / 1024) * 0.01f;
+            for (int corner = 0; corner < 4; corner++) {
+                float cx = x + (corner == 1 || corner == 2 ? 0.01f : 0.0f);
+                float cz = z + (corner >= 2 ? 0.01f : 0.0f);
+                int length = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 1 0\n",
+                                      cx, std::sin(cx) * std::cos(cz), cz, cx * 0.5f, cz * 0.5f);
+                out.write(line, length);
+                written += (size_t)length;
+            }
+
+            const char* face = "f -4/-4/-4 -3/-3/-3 -2/-2/-2 -1/-1/-1\n";
+            out.write(face, (std::streamsize)strlen(face));
+            written += strlen(face);
+        }
+        return (bool)out;
+    }
+
+    bool SameFloats(const std::vector<float>& a, const std::vector<float>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            //both round the decimal text to the nearest float, within an ulp or so
+            if (std::fabs(a[i] - b[i]) > 1e-6f * std::max(1.0f, std::fabs(a[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SameResult(const ObjResult& a, const ObjResult& b) {
+        if (!SameFloats(a.attrib.vertices, b.attrib.vertices) || !SameFloats(a.attrib.normals, b.attrib.normals) ||
+            !SameFloats(a.attrib.texcoords, b.attrib.texcoords) || a.materials.size() != b.materials.size() ||
+            a.shapes.size() != b.shapes.size()) {
+            return false;
+        }
+        for (size_t s = 0; s < a.shapes.size(); s++) {
+            const tinyobj::mesh_t& x = a.shapes[s].mesh;
+            const tinyobj::mesh_t& y = b.shapes[s].mesh;
+            if (a.shapes[s].name != b.shapes[s].name || x.indices.size() != y.indices.size() ||
+                x.num_face_vertices != y.num_face_vertices || x.material_ids != y.material_ids) {
+                return false;
+            }
+            for (size_t i = 0; i < x.indices.size(); i++) {
+                if (x.indices[i].vertex_index != y.indices[i].vertex_index ||
+                    x.indices[i].normal_index != y.indices[i].normal_index ||
+                    x.indices[i].texcoord_index != y.indices[i].texcoord_index) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 0 when the parse was too quick for the clock to measure
+    double MegabytesPerSecond(double megabytes, double seconds) {
+        return seconds > 0.0 ? megabytes / seconds : 0.0;
+    }
+
+    // Best time of `runs` parses with either parser, keeping the last result
+    double TimeParse(const std::string& fileName, bool mapped, unsigned int threads, int runs, ObjResult& result) {
+        std::string basePath = BasePath(fileName);
+        double best = 0.0;
+        for (int run = 0; run < runs; run++) {
+            result = ObjResult();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (mapped) {
+                result.loaded = gps::LoadObjMapped(&result.attrib, &result.shapes, &result.materials, &result.err,
+                                                   fileName.c_str(), basePath.c_str(), true, NULL, threads);
+            } else {
+                result.loaded = tinyobj::LoadObj(&result.attrib, &result.shapes, &result.materials, &result.err,
+                                                 fileName.c_str(), basePath.c_str(), true);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || seconds < best) {
+                best = seconds;
+            }
+        }
+        return best;
+    }
+
+    bool Benchmark(const std::string& fileName, unsigned int threads, int runs) {
+        double megabytes = FileBytes(fileName) / (1024.0 * 1024.0);
+
+        ObjResult reference;
+        ObjResult mapped;
+        double tinyobjSeconds = TimeParse(fileName, false, threads, runs, reference);
+        double mappedSeconds = TimeParse(fileName, true, threads, runs, mapped);
+
+        if (!reference.loaded || !mapped.loaded) {
+            fprintf(stderr, "ERROR: could not parse %s\n", fileName.c_str());
+            return false;
+        }
+
+        bool same = SameResult(reference, mapped);
+        printf("%s (%.2f MB): tinyobj::LoadObj %.1f MB/s, gps::LoadObjMapped %.1f MB/s on %u thread(s), %.2fx, %s\n",
+               fileName.c_str(), megabytes, MegabytesPerSecond(megabytes, tinyobjSeconds),
+               MegabytesPerSecond(megabytes, mappedSeconds), gps::ThreadPool::resolveThreadCount(threads),
+               mappedSeconds > 0.0 ? tinyobjSeconds / mappedSeconds : 0.0, same ? "identical" : "RESULTS DIFFER");
+        return same;
+    }
+
+    void PrintUsage() {
+        fprintf(stderr, "usage: objbench [-n runs] [-j threads] [--synthetic MB] [file.obj]...\n");
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    int runs = 5;
+    unsigned int threads = 1;
+    size_t syntheticMegabytes = 15;
+
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            runs = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            syntheticMegabytes = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (argv[i][0] == '-') {
+            PrintUsage();
+            return EXIT_FAILURE;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    bool synthetic = files.empty();
+    if (synthetic) {
+        files.push_back("models/teapot/teapot20segUT.obj");
+        if (!WriteSyntheticObj(SYNTHETIC_FILE, syntheticMegabytes)) {
+            fprintf(stderr, "ERROR: could not write %s\n", SYNTHETIC_FILE);
+            return EXIT_FAILURE;
+        }
+        files.push_back(SYNTHETIC_FILE);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        ok = Benchmark(files[i], threads, runs) && ok;
+    }
+
+    if (synthetic) {
+        std::remove(SYNTHETIC_FILE);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,242 @@
+// texconv: converts the textures referenced by .mtl files (or images given
+// directly) to block compressed .dds files with a full mip chain. Each .dds is
+// written next to its source image, where Model3D picks it up instead.
+//
+//   texconv [-f bc1|bc3|bc5|bc7] [--linear] [--verify] [-j threads] <file.mtl | image>...
+//
+// Color maps default to BC7 in sRGB, bump maps to BC5. Mips are Kaiser
+// filtered, in linear light for sRGB maps. --verify reads every
+// file back, decodes it on the CPU and reports the PSNR of the top level.
+//
+// Build from the repository root:
+//   g++ -std=c++14 -O2 -I. tools/texconv.cpp TextureCompression.cpp TextureFile.cpp Mipmaps.cpp
+//       MappedFile.cpp ThreadPool.cpp stb_image.cpp tiny_obj_loader.cpp -lpthread -o texconv
+
+#include "TextureCompression.hpp"
+#include "TextureFile.hpp"
+#include "Mipmaps.hpp"
+#include "ThreadPool.hpp"
+
+#include "stb_image.h"
+#include "tiny_obj_loader.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct ConvertJob {
+        std::string image;
+        gps::BlockFormat format;
+        bool srgb;
+    };
+
+    struct Options {
+        bool formatForced;
+        gps::BlockFormat format;
+        bool linear;
+        bool verify;
+        unsigned int threads;
+    };
+
+    bool ParseFormat(const char* name, gps::BlockFormat& format) {
+        if (strcmp(name, "bc1") == 0) { format = gps::BLOCK_BC1; return true; }
+        if (strcmp(name, "bc3") == 0) { format = gps::BLOCK_BC3; return true; }
+        if (strcmp(name, "bc5") == 0) { format = gps::BLOCK_BC5; return true; }
+        if (strcmp(name, "bc7") == 0) { format = gps::BLOCK_BC7; return true; }
+        return false;
+    }
+
+    bool EndsWith(const std::string& text, const char* suffix) {
+        size_t length = strlen(suffix);
+        return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+    }
+
+    std::string DirectoryOf(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    void AddJob(std::vector<ConvertJob>& jobs, const std::string& image, gps::BlockFormat format, bool srgb,
+                const Options& options) {
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i].image == image) {
+                return;
+            }
+        }
+
+        ConvertJob job;
+        job.image = image;
+        job.format = options.formatForced ? options.format : format;
+        job.srgb = !options.linear && srgb && job.format != gps::BLOCK_BC5;
+        jobs.push_back(job);
+    }
+
+    // Queues the maps Model3D binds (ambient, diffuse, specular) plus bump maps
+    bool CollectMaterialTextures(const std::string& mtlFileName, std::vector<ConvertJob>& jobs, const Options& options) {
+        std::ifstream stream(mtlFileName.c_str());
+        if (!stream) {
+            fprintf(stderr, "ERROR: could not open %s\n", mtlFileName.c_str());
+            return false;
+        }
+
+        std::map<std::string, int> materialMap;
+        std::vector<tinyobj::material_t> materials;
+        tinyobj::LoadMtl(&materialMap, &materials, &stream);
+
+        std::string basePath = DirectoryOf(mtlFileName);
+        for (size_t m = 0; m < materials.size(); m++) {
+            const tinyobj::material_t& material = materials[m];
+            const std::string* colorMaps[3] = { &material.ambient_texname, &material.diffuse_texname, &material.specular_texname };
+
+            for (int i = 0; i < 3; i++) {
+                if (!colorMaps[i]->empty() && !gps::IsCompressedTextureFile(*colorMaps[i])) {
+                    AddJob(jobs, basePath + *colorMaps[i], gps::BLOCK_BC7, true, options);
+                }
+            }
+            if (!material.bump_texname.empty() && !gps::IsCompressedTextureFile(material.bump_texname)) {
+                AddJob(jobs, basePath + material.bump_texname, gps::BLOCK_BC5, false, options);
+            }
+        }
+        return true;
+    }
+
+    double PeakSignalToNoise(const unsigned char* a, const unsigned char* b, size_t pixels, int channels) {
+        double squared = 0.0;
+        for (size_t i = 0; i < pixels; i++) {
+            for (int c = 0; c < channels; c++) {
+                double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+                squared += d * d;
+            }
+        }
+        if (squared == 0.0) {
+            return INFINITY;
+        }
+        return 10.0 * std::log10(255.0 * 255.0 / (squared / (double)(pixels * channels)));
+    }
+
+    bool Convert(const ConvertJob& job, const Options& options, gps::ThreadPool& workers) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        int width, height, channels;
+        //rows stay in file order, like Model3D loads them
+        stbi_set_flip_vertically_on_load(0);
+        unsigned char* pixels = stbi_load(job.image.c_str(), &width, &height, &channels, 4);
+        if (!pixels) {
+            fprintf(stderr, "ERROR: could not load %s\n", job.image.c_str());
+            return false;
+        }
+
+        // Gamma-correct mips first, then every level is compressed on its own
+        gps::CompressedTexture chain;
+        gps::GenerateMipChain(pixels, width, height, job.srgb, gps::MIP_FILTER_KAISER, chain);
+        stbi_image_free(pixels);
+
+        gps::CompressedTexture texture;
+        gps::AllocateLevels(job.format, job.srgb, width, height, texture);
+
+        for (size_t i = 0; i < texture.levels.size(); i++) {
+            const gps::TextureLevel& target = texture.levels[i];
+            gps::CompressImage(chain.data.data() + chain.levels[i].offset, target.width, target.height, job.format,
+                               texture.data.data() + target.offset, &workers);
+        }
+
+        std::string outputName = gps::CompressedTextureFileName(job.image);
+        if (!gps::WriteDDS(outputName, texture)) {
+            fprintf(stderr, "ERROR: could not write %s\n", outputName.c_str());
+            return false;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t uncompressed = (size_t)width * height * 4;
+        uncompressed += uncompressed / 3;
+
+        std::cout << outputName << " : " << width << "x" << height << " " << gps::BlockFormatName(job.format)
+                  << (job.srgb ? " sRGB" : "") << ", " << texture.levels.size() << " levels, "
+                  << texture.data.size() / 1024 << " KB (" << (double)uncompressed / texture.data.size()
+                  << "x smaller) in " << seconds * 1000.0 << " ms";
+
+        if (options.verify) {
+            gps::CompressedTexture written;
+            if (!gps::ReadDDS(outputName, written) || written.data != texture.data ||
+                written.levels.size() != texture.levels.size() || written.format != texture.format) {
+                std::cout << std::endl;
+                fprintf(stderr, "ERROR: %s does not read back\n", outputName.c_str());
+                return false;
+            }
+
+            std::vector<unsigned char> decoded((size_t)width * height * 4);
+            gps::DecompressImage(written.data.data(), width, height, written.format, decoded.data());
+            int compared = job.format == gps::BLOCK_BC5 ? 2 : (job.format == gps::BLOCK_BC1 ? 3 : 4);
+            std::cout << ", PSNR " << PeakSignalToNoise(chain.data.data(), decoded.data(), (size_t)width * height, compared) << " dB";
+        }
+
+        std::cout << std::endl;
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(stderr, "usage: texconv [-f bc1|bc3|bc5|bc7] [--linear] [--verify] [-j threads] <file.mtl | image>...\n");
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    Options options;
+    options.formatForced = false;
+    options.format = gps::BLOCK_BC7;
+    options.linear = false;
+    options.verify = false;
+    options.threads = 0;
+
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            if (!ParseFormat(argv[++i], options.format)) {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+            options.formatForced = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.threads = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--linear") == 0) {
+            options.linear = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            options.verify = true;
+        } else if (argv[i][0] == '-') {
+            PrintUsage();
+            return EXIT_FAILURE;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (inputs.empty()) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ConvertJob> jobs;
+    bool ok = true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (EndsWith(inputs[i], ".mtl")) {
+            ok = CollectMaterialTextures(inputs[i], jobs, options) && ok;
+        } else {
+            AddJob(jobs, inputs[i], gps::BLOCK_BC7, true, options);
+        }
+    }
+
+    gps::ThreadPool workers(options.threads);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        ok = Convert(jobs[i], options, workers) && ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}